@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common/util.h"
+
 //
 // Generic callback manager
 //
@@ -8,6 +10,10 @@
 // eg: if the callback should be `cb(void* userdata, int my_data)`
 //     define a `CallbackManager<int> int_callbacks;`
 //
+// Managers can also keep a bit in some subscription bitmask up to date (see
+// track), so hot code can check for subscribers to any number of managers
+// with a single branch.
+//
 
 template <typename ...cb_args>
 class CallbackManager {
@@ -30,6 +36,16 @@ private:
   // linked list
   cb_node* cbs = nullptr;
 
+  // subscription bitmask (see track)
+  uint* mask = nullptr;
+  uint  bit  = 0;
+
+  void update_mask() {
+    if (!this->mask) return;
+    if (this->cbs) *this->mask |=  this->bit;
+    else           *this->mask &= ~this->bit;
+  }
+
 public:
   ~CallbackManager() {
     while (this->cbs) {
@@ -46,8 +62,31 @@ public:
       n->next = this->cbs;
       this->cbs = n;
     }
+    this->update_mask();
   }
 
+  // Removes a callback added with add_cb (not from inside a callback though!)
+  void remove_cb(cb_t function, void* userdata) {
+    for (cb_node** n = &this->cbs; *n; n = &(*n)->next) {
+      if ((*n)->cb == function && (*n)->userdata == userdata) {
+        cb_node* dead = *n;
+        *n = dead->next;
+        delete dead;
+        break;
+      }
+    }
+    this->update_mask();
+  }
+
+  // Sets `bit` in `*mask` whenever there are any callbacks
+  void track(uint* mask, uint bit) {
+    this->mask = mask;
+    this->bit = bit;
+    this->update_mask();
+  }
+
+  bool empty() const { return this->cbs == nullptr; }
+
   void run(cb_args... args) const {
     cb_node* n = this->cbs;
     while (n) {
@@ -3,7 +3,6 @@
 #include <cassert>
 #include <cstdio>
 #include <cstring>
-#include <climits>
 
 /*------------------------------  Lookup Tables  -----------------------------*/
 
@@ -51,22 +50,20 @@ static constexpr uint DMC_PERIOD_TABLE [] = {
 
 /*---------------------------------  APU I/O  --------------------------------*/
 
-APU::~APU() {
-  for (FirstOrderFilter* filter : this->filters) delete filter;
-}
-
 APU::APU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
 : interrupt(interrupt)
 , mem(mem)
+, filters(params.apu_sample_rate, params.apu_oversample)
 , sample_rate(params.apu_sample_rate)
 {
   this->chan.pulse2.isPulse2 = true;
-  this->power_cycle();
 
-  // Setup filters
-  this->filters[0] = new HiPassFilter (90,    params.apu_sample_rate);
-  this->filters[1] = new HiPassFilter (440,   params.apu_sample_rate);
-  this->filters[2] = new LoPassFilter (14000, params.apu_sample_rate);
+  this->blip_time = 0;
+  this->output_level = 0;
+  this->lag = 0;
+
+  this->power_cycle();
+  this->update_rates();
 }
 
 // https://wiki.nesdev.com/w/index.php/CPU_power_up_state
@@ -85,12 +82,19 @@ void APU::reset() {
   this->seq_step = 0;
   (*this)[0x4015] = 0x00; // silence APU
   this->frame_counter.inhibit_irq = true;
+  this->output_changed = true;
+
+  this->lag = 0;
+  this->sync_in = this->cycles_until_sync();
 }
 
 u8 APU::read(u16 addr) {
+  this->sync();
+
   u8 retval = this->peek(addr);
   if (addr == 0x4015) {
     this->frame_counter.inhibit_irq = true;
+    this->sync_in = this->cycles_until_sync();
   }
   return retval;
 }
@@ -126,6 +130,9 @@ void APU::write(u16 addr, u8 val) {
   //     fprintf(stderr, "[APU] mode: %s\n", (val & 0x80) ? "5" : "4");
   // }
 
+  this->sync();
+  this->output_changed = true;
+
   switch (addr) {
 #define pulse_impl(pulse, baddr) /* pulse1 and pulse2 are near identical... */ \
   case baddr+0: { this->chan.pulse.duty_cycle       =   (val & 0xC0) >> 6;     \
@@ -228,7 +235,7 @@ void APU::write(u16 addr, u8 val) {
   // Frame Counter
   case 0x4017:  { this->frame_counter.val = val;
                   if (this->frame_counter.five_frame_seq) {
-                    this->clock_timers();
+                    this->clock_timers(); // (output_changed is already set)
                     this->clock_length_counters();
                     this->clock_sweeps();
                   }
@@ -237,6 +244,8 @@ void APU::write(u16 addr, u8 val) {
     // fprintf(stderr, "[APU] Writing to Read-Only register: 0x%04X\n", addr);
     break;
   }
+
+  this->sync_in = this->cycles_until_sync();
 }
 
 /*------------------------------  APU Channels  ------------------------------*/
@@ -271,13 +280,12 @@ void APU::LenCount::clock() {
 // https://wiki.nesdev.com/w/index.php/APU_Pulse
 // https://wiki.nesdev.com/w/index.php/APU_Sweep
 
-void APU::Channels::Pulse::timer_clock() {
-  if (this->timer_val) { this->timer_val--; }
-  else {
-    this->timer_val = this->timer_period;
-    // Clock sequencer (duty step)
-    this->duty_val = (this->duty_val + 1) % 8;
-  }
+bool APU::Channels::Pulse::timer_clock() {
+  if (this->timer_val) { this->timer_val--; return false; }
+  this->timer_val = this->timer_period;
+  // Clock sequencer (duty step)
+  this->duty_val = (this->duty_val + 1) % 8;
+  return this->enabled && this->len_count.val;
 }
 
 void APU::Channels::Pulse::sweep_clock() {
@@ -311,7 +319,7 @@ u8 APU::Channels::Pulse::output() const {
     || !active
     // || sweep-adder overflow?
     || !this->len_count.val
-    || this->timer_val < 8
+    || this->timer_period < 8
     || this->timer_period > 0x7FF
   ) return 0;
 
@@ -323,13 +331,12 @@ u8 APU::Channels::Pulse::output() const {
 /*--------  Triangle  --------*/
 // https://wiki.nesdev.com/w/index.php/APU_Triangle
 
-void APU::Channels::Triangle::timer_clock() {
-  if (this->timer_val) { this->timer_val--; }
-  else {
-    this->timer_val = this->timer_period;
-    // Clock sequencer (duty step)
-    this->duty_val = (this->duty_val + 1) % 32;
-  }
+bool APU::Channels::Triangle::timer_clock() {
+  if (this->timer_val) { this->timer_val--; return false; }
+  this->timer_val = this->timer_period;
+  // Clock sequencer (duty step)
+  this->duty_val = (this->duty_val + 1) % 32;
+  return this->enabled && this->len_count.val && this->lin_count_val;
 }
 
 void APU::Channels::Triangle::lin_count_clock() {
@@ -352,19 +359,18 @@ u8 APU::Channels::Triangle::output() const {
 /*--------  Noise  --------*/
 // https://wiki.nesdev.com/w/index.php/APU_Noise
 
-void APU::Channels::Noise::timer_clock() {
-  if (this->timer_val) { this->timer_val--; }
-  else {
-    this->timer_val = this->timer_period;
-    // When the timer clocks the shift register, the following occur in order:
-    // 1) Feedback is calculated as the exclusive-OR of bit 0 and one other bit:
-    //      bit 6 if Mode flag is set, otherwise bit 1.
-    bool fb = nth_bit(this->sr, 0) ^ nth_bit(this->sr, this->mode ? 6 : 1);
-    // 2) The shift register is shifted right by one bit.
-    this->sr >>= 1;
-    // 3) Bit 14, the leftmost bit, is set to the feedback calculated earlier.
-    this->sr |= fb << 14;
-  }
+bool APU::Channels::Noise::timer_clock() {
+  if (this->timer_val) { this->timer_val--; return false; }
+  this->timer_val = this->timer_period;
+  // When the timer clocks the shift register, the following occur in order:
+  // 1) Feedback is calculated as the exclusive-OR of bit 0 and one other bit:
+  //      bit 6 if Mode flag is set, otherwise bit 1.
+  bool fb = nth_bit(this->sr, 0) ^ nth_bit(this->sr, this->mode ? 6 : 1);
+  // 2) The shift register is shifted right by one bit.
+  this->sr >>= 1;
+  // 3) Bit 14, the leftmost bit, is set to the feedback calculated earlier.
+  this->sr |= fb << 14;
+  return this->enabled && this->len_count.val;
 }
 
 u8 APU::Channels::Noise::output() const {
@@ -410,8 +416,8 @@ void APU::Channels::DMC::dmc_transfer(Memory& mem, InterruptLines& interrupt) {
   }
 }
 
-void APU::Channels::DMC::timer_clock(Memory& mem, InterruptLines& interrupt) {
-  if (this->timer_val) { this->timer_val--; return; }
+bool APU::Channels::DMC::timer_clock(Memory& mem, InterruptLines& interrupt) {
+  if (this->timer_val) { this->timer_val--; return false; }
   this->timer_val = this->timer_period;
 
   // When the timer outputs a clock, the following actions occur in order:
@@ -446,6 +452,8 @@ void APU::Channels::DMC::timer_clock(Memory& mem, InterruptLines& interrupt) {
       this->dmc_transfer(mem, interrupt);
     }
   }
+
+  return this->enabled;
 }
 
 u8 APU::Channels::DMC::output() const {
@@ -461,13 +469,14 @@ void APU::clock_timers() {
   // The triangle channel's timer is clocked on every CPU cycle, but the pulse,
   //  noise, and DMC timers are clocked only on every second CPU cycle
   //  (and thus produce only even periods).
-  this->chan.tri.timer_clock();
+  bool changed = this->chan.tri.timer_clock();
   if (this->cycles % 2) {
-    this->chan.pulse1.timer_clock();
-    this->chan.pulse2.timer_clock();
-    this->chan.noise.timer_clock();
-    this->chan.dmc.timer_clock(this->mem, this->interrupt); // ugly param pass
+    changed |= this->chan.pulse1.timer_clock();
+    changed |= this->chan.pulse2.timer_clock();
+    changed |= this->chan.noise.timer_clock();
+    changed |= this->chan.dmc.timer_clock(this->mem, this->interrupt); // ugly
   }
+  this->output_changed |= changed;
 }
 
 void APU::clock_length_counters() {
@@ -538,31 +547,101 @@ void APU::cycle() {
       }
     }
     this->seq_step++;
+    this->output_changed = true;
+  }
+
+  if (this->output_changed) this->update_output();
+
+  // Audio frames usually end when the frontend grabs the audio-buffer, but
+  // they can't go on for longer than the BlipBuffer can hold
+  if (++this->blip_time == this->blip.max_frame_clocks())
+    this->end_audio_frame();
+}
+
+// Instead of sampling the mixer every so often (and aliasing like crazy), any
+// change in its output is recorded as a band-limited step.
+void APU::update_output() {
+  this->output_changed = false;
+
+  const float level = this->mixer.sample(
+    this->chan.pulse1.output(),
+    this->chan.pulse2.output(),
+    this->chan.tri.output(),
+    this->chan.noise.output(),
+    this->chan.dmc.output()
+  );
+
+  if (level == this->output_level) return;
+  this->blip.add_delta(this->blip_time, level - this->output_level);
+  this->output_level = level;
+}
+
+// Turns the current audio frame into samples, and sends them off to the
+// audio-buffer!
+void APU::end_audio_frame() {
+  this->blip.end_frame(this->blip_time);
+  this->blip_time = 0;
+
+  // Run though filter chain (all in one go)
+  float* block = this->audio_block;
+  uint len = this->blip.read_samples(block, BlipBuffer::MAX_SAMPLES);
+  len = this->filters.process(block, len);
+
+  // Drop whatever doesn't fit in the audio-buffer
+  const uint space = 4096 - this->audiobuff.i;
+  if (len > space) len = space;
+
+  memcpy(this->audiobuff.data + this->audiobuff.i, block, len * sizeof *block);
+  this->audiobuff.i += len;
+}
+
+/*-------------------------------  Lazy Catch-up  ----------------------------*/
+
+void APU::run(uint cycles) {
+  this->lag += cycles;
+  if (this->lag >= this->sync_in)
+    this->sync();
+}
+
+void APU::sync() {
+  for (; this->lag; this->lag--)
+    this->cycle();
+
+  this->sync_in = this->cycles_until_sync();
+}
+
+// The APU has to be caught up before it fires an IRQ or stalls the CPU, and
+// it shouldn't fall further behind than a single audio frame can hold.
+uint APU::cycles_until_sync() const {
+  uint cycles = this->blip.max_frame_clocks();
+
+  // Frame IRQ fires on the last step of the 4-step sequence
+  if (!this->frame_counter.five_frame_seq && !this->frame_counter.inhibit_irq) {
+    const uint period = this->clock_rate / 240;
+    const uint next_step = period - this->cycles % period;
+    cycles = next_step + period * (3 - this->seq_step % 4);
   }
 
-  // Sample APU
-  if (this->cycles % (this->clock_rate / this->sample_rate) == 0) {
-    // Get the sample from the mixer
-    float sample = this->mixer.sample(
-      this->chan.pulse1.output(),
-      this->chan.pulse2.output(),
-      this->chan.tri.output(),
-      this->chan.noise.output(),
-      this->chan.dmc.output()
-    );
-
-    // Run though filter chain
-    for (FirstOrderFilter* filter : this->filters)
-      sample = filter->process(sample);
-
-    // Send it off the the audio-buffer!
-    audiobuff.data[audiobuff.i] = sample;
-    if (audiobuff.i < 4095) audiobuff.i++;
+  // DMC sample buffer is refilled (stalling the CPU, and maybe firing an IRQ)
+  // when the output unit finishes with the current sample byte
+  const Channels::DMC& dmc = this->chan.dmc;
+  if (!dmc.read_buffer_empty && dmc.read_remaining) {
+    const uint bits = dmc.output_bits_remaining ? dmc.output_bits_remaining : 1;
+    const uint timer_clocks = (dmc.timer_val + 1)
+                            + (bits - 1) * (dmc.timer_period + 1);
+    // DMC timer is clocked every other cycle
+    const uint first_clock = (this->cycles % 2) ? 2 : 1;
+    const uint dmc_cycles = first_clock + (timer_clocks - 1) * 2;
+    if (dmc_cycles < cycles) cycles = dmc_cycles;
   }
+
+  return cycles;
 }
 
 void APU::getAudiobuff(float** samples, uint* len) {
   if (samples == nullptr || len == nullptr) return;
+  this->sync();
+  this->end_audio_frame();
   *samples = this->audiobuff.data;
   *len = this->audiobuff.i;
   this->audiobuff.i = 0;
@@ -570,4 +649,22 @@ void APU::getAudiobuff(float** samples, uint* len) {
 
 void APU::set_speed(float speed) {
   this->clock_rate = 1789773 * speed;
+  this->update_rates();
+}
+
+void APU::set_rate_adjust(float ratio) {
+  this->rate_adjust = ratio;
+  this->update_rates();
+}
+
+void APU::update_rates() {
+  // Finish off the audio frame at the old rates
+  this->sync();
+  this->end_audio_frame();
+
+  const double synth_rate = double(this->sample_rate)
+                          * this->filters.get_oversample()
+                          * this->rate_adjust;
+  this->blip.set_rates(this->clock_rate, synth_rate);
+  this->sync_in = this->cycles_until_sync();
 }
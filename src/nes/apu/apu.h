@@ -8,6 +8,7 @@
 #include "nes/params.h"
 
 #include "nes/wiring/interrupt_lines.h"
+#include "blip_buffer.h"
 #include "filters.h"
 
 // NES APU
@@ -83,7 +84,7 @@ private:
       u16  timer_val;
 
       void sweep_clock();
-      void timer_clock();
+      bool timer_clock(); // returns true if the output might've changed
 
       u8 output() const;
 
@@ -109,7 +110,7 @@ private:
       u8   duty_val;
       u16  timer_val;
 
-      void timer_clock();
+      bool timer_clock(); // returns true if the output might've changed
       void lin_count_clock();
 
       u8 output() const;
@@ -135,7 +136,7 @@ private:
       u16 sr;
       u16 timer_val;
 
-      void timer_clock();
+      bool timer_clock(); // returns true if the output might've changed
 
       u8 output() const;
     } noise;
@@ -164,7 +165,8 @@ private:
       // Emulator
       bool dmc_stall;
 
-      void timer_clock(Memory& mem, InterruptLines& interrupt);
+      // returns true if the output might've changed
+      bool timer_clock(Memory& mem, InterruptLines& interrupt);
 
       void dmc_transfer(Memory& mem, InterruptLines& interrupt);
 
@@ -196,7 +198,7 @@ private:
 
   /*----------  Emulation Vars  ----------*/
 
-  FirstOrderFilter* filters [3]; // Hi/Lo pass filter chain
+  FilterChain filters; // Hi/Lo pass filter chain (+ oversampling)
 
   uint cycles;   // Total Cycles elapsed
   uint seq_step; // Frame Sequence Step
@@ -207,13 +209,39 @@ private:
   } audiobuff;
 
   uint clock_rate = 1789773; // changes when speeding up / slowing down NES
-
-  SERIALIZE_START(4, "APU")
+  float rate_adjust = 1.0;   // output rate multiplier (see set_rate_adjust)
+
+  // Output is synthesized from changes in the mixer's level (see BlipBuffer),
+  // which only need to be checked when some channel's output might've changed
+  // (i.e: an audible channel's sequencer stepped, or some register changed)
+  BlipBuffer blip;
+  uint  blip_time;      // cycles since the start of the current audio frame
+  float output_level;   // last mixer level sent to the BlipBuffer
+  bool  output_changed; // set whenever a channel's output might've changed
+
+  float audio_block [BlipBuffer::MAX_SAMPLES]; // samples from the BlipBuffer
+
+  // Lazy catch-up
+  // The APU is allowed to fall behind the CPU, and only catches up once the
+  // CPU touches its registers, once it's about to fire an IRQ or stall the CPU,
+  // or once its audio is asked for (see APU::run).
+  uint lag;     // cycles the APU has fallen behind by
+  uint sync_in; // lag at which the APU has to catch up
+
+  SERIALIZE_START(6, "APU")
     SERIALIZE_POD(chan)
     SERIALIZE_POD(frame_counter)
     SERIALIZE_POD(cycles)
     SERIALIZE_POD(seq_step)
-  SERIALIZE_END(4)
+    SERIALIZE_POD(lag)
+    SERIALIZE_POD(sync_in)
+  SERIALIZE_END(6)
+
+  virtual const Serializable::Chunk* deserialize(const Serializable::Chunk* c) override {
+    c = this->Serializable::deserialize(c);
+    this->output_changed = true;
+    return c;
+  }
 
   /*----------  Helpers  ----------*/
 
@@ -222,6 +250,13 @@ private:
   void clock_timers();
   void clock_length_counters();
 
+  void update_output();
+  void end_audio_frame();
+
+  uint cycles_until_sync() const;
+
+  void update_rates();
+
   class Mixer {
   private:
     float pulse_table [31];
@@ -235,7 +270,6 @@ private:
   const uint& sample_rate;
 
 public:
-  ~APU();
   APU() = delete;
   APU(const NES_Params& params, Memory& mem, InterruptLines& interrupt);
 
@@ -249,6 +283,16 @@ public:
   void reset();
 
   void cycle();
+
+  // Run for some number of cycles... eventually (see lag)
+  void run(uint cycles);
+  // Catch up right away
+  void sync();
+
+  // Number of cycles until the next cycle that might fire an IRQ or stall the
+  // CPU (i.e: frame IRQs, DMC sample fetches). Might be too early.
+  uint cycles_until_event() const { return this->sync_in - this->lag; }
+
   bool stall_cpu() {
     bool stall = this->chan.dmc.dmc_stall;
     this->chan.dmc.dmc_stall = false;
@@ -257,4 +301,9 @@ public:
 
   void getAudiobuff(float** samples, uint* len);
   void set_speed(float speed);
+
+  // Produce slightly more / fewer samples than the sample rate calls for
+  // (e.g: to keep an audio queue from running dry / overflowing when video is
+  // synced to a display that isn't quite the NES's refresh rate)
+  void set_rate_adjust(float ratio);
 };
@@ -0,0 +1,97 @@
+#include "blip_buffer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// Each kernel is the difference between consecutive samples of a band-limited
+// step (the integral of a windowed sinc), for one sub-sample phase. The step
+// is centered TAPS / 2 samples in, which is how far output lags behind.
+BlipBuffer::BlipBuffer() {
+  const uint   phases = 1 << PHASE_BITS;
+  const double cutoff = 0.45; // (cycles per sample, i.e: just under nyquist)
+  const double width  = TAPS / 2 - 1; // of the windowed sinc, either side
+  const uint   steps  = 64; // integration steps per sample
+
+  const double pi = 3.14159265358979323846;
+
+  for (uint phase = 0; phase < phases; phase++) {
+    const double center = TAPS / 2 + double(phase) / phases;
+
+    double total = 0;
+    for (uint tap = 0; tap < TAPS; tap++) {
+      double sum = 0;
+      for (uint step = 0; step < steps; step++) {
+        const double x = tap - 1 + (step + 0.5) / steps - center;
+        if (fabs(x) >= width) continue;
+
+        const double y = 2 * cutoff * x;
+        const double sinc = y == 0 ? 1 : sin(pi * y) / (pi * y);
+        const double blackman = 0.42
+                              + 0.50 * cos(pi * x / width)
+                              + 0.08 * cos(2 * pi * x / width);
+        sum += 2 * cutoff * sinc * blackman / steps;
+      }
+      this->kernel[phase][tap] = sum;
+      total += sum;
+    }
+
+    // every step has to add up to exactly the delta
+    for (uint tap = 0; tap < TAPS; tap++)
+      this->kernel[phase][tap] /= total;
+  }
+
+  this->set_rates(1, 1);
+  this->clear();
+}
+
+void BlipBuffer::set_rates(double clock_rate, double sample_rate) {
+  this->factor = u64(sample_rate / clock_rate * 4294967296.0 + 0.5);
+  this->max_clocks = ((u64(MAX_SAMPLES - 1) << 32) / this->factor) - 1;
+}
+
+void BlipBuffer::clear() {
+  memset(this->buf, 0, sizeof this->buf);
+  this->offset = 0;
+  this->avail = 0;
+  this->integrator = 0;
+}
+
+void BlipBuffer::add_delta(uint time, double delta) {
+  const u64  pos   = this->offset + u64(time) * this->factor;
+  const uint index = pos >> 32;
+  const uint phase = (pos >> (32 - PHASE_BITS)) & ((1 << PHASE_BITS) - 1);
+
+  assert(index < MAX_SAMPLES);
+
+  double* out = this->buf + index;
+  const double* kernel = this->kernel[phase];
+  for (uint tap = 0; tap < TAPS; tap++)
+    out[tap] += delta * kernel[tap];
+}
+
+void BlipBuffer::end_frame(uint time) {
+  this->offset += u64(time) * this->factor;
+  this->avail = this->offset >> 32;
+
+  assert(this->avail < MAX_SAMPLES);
+}
+
+uint BlipBuffer::read_samples(float* out, uint len) {
+  const uint count = len < this->avail ? len : this->avail;
+
+  for (uint i = 0; i < count; i++) {
+    this->integrator += this->buf[i];
+    if (out) out[i] = float(this->integrator);
+  }
+
+  // Shift the rest (including the tails of the latest steps) to the front
+  const uint remaining = this->avail - count + TAPS;
+  memmove(this->buf, this->buf + count, remaining * sizeof this->buf[0]);
+  memset(this->buf + remaining, 0, count * sizeof this->buf[0]);
+
+  this->offset -= u64(count) << 32;
+  this->avail -= count;
+
+  return count;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common/util.h"
+
+// Band-limited sound synthesis (in the style of blargg's blip_buf)
+//
+// Instead of point-sampling the APU's output every so many clocks (which
+// aliases), the APU only reports changes in its output level ("deltas"),
+// timestamped in clocks. Each delta gets drawn into the buffer as a
+// band-limited step (i.e: a step without anything above the output's nyquist
+// frequency) at sub-sample precision, and at the end of each frame the deltas
+// are summed back up into samples.
+//
+// Clocks are mapped to samples with 32.32 fixed point, so the output sample
+// rate is exact (instead of being rounded to a whole number of clocks).
+class BlipBuffer {
+public:
+  enum : uint {
+    PHASE_BITS  = 5,    // sub-sample step positions (as a power of 2)
+    TAPS        = 16,   // width of a step (in samples)
+    MAX_SAMPLES = 4096, // most samples that can be buffered
+  };
+
+private:
+  double kernel [1 << PHASE_BITS][TAPS];
+  double buf [MAX_SAMPLES + TAPS];
+
+  u64  factor; // samples per clock (32.32 fixed point)
+  uint max_clocks;
+  u64  offset; // sample position of the current frame's start (32.32)
+  uint avail;  // samples ready to be read
+
+  double integrator;
+
+public:
+  BlipBuffer();
+
+  void set_rates(double clock_rate, double sample_rate);
+  void clear();
+
+  // Longest a single frame can be (in clocks) without overflowing the buffer,
+  // once all available samples have been read
+  uint max_frame_clocks() const { return this->max_clocks; }
+
+  // Output level changes by `delta` at `time` clocks into the current frame
+  void add_delta(uint time, double delta);
+
+  // Ends the current frame `time` clocks in, making its samples available
+  void end_frame(uint time);
+
+  uint samples_avail() const { return this->avail; }
+
+  // Reads up to `len` samples into `out` (or discards them, if out is null),
+  // returning how many there were
+  uint read_samples(float* out, uint len);
+};
@@ -0,0 +1,89 @@
+#include "filters.h"
+
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+FilterChain::FilterChain(hertz sample_rate, uint oversample)
+: oversample(oversample ? oversample : 1)
+, phase(0)
+{
+  const double dt = 1.0 / double(sample_rate);
+  const auto RC = [](hertz f) { return 1.0 / (2 * PI * double(f)); };
+
+  this->hi_90  = { float(RC(90)  / (RC(90)  + dt)), 0, 0 };
+  this->hi_440 = { float(RC(440) / (RC(440) + dt)), 0, 0 };
+  this->lo_14k = { float(dt / (RC(14000) + dt)),    0, 0 };
+
+  // 4th order Butterworth = two biquads, with these Q's
+  // http://www.musicdsp.org/files/Audio-EQ-Cookbook.txt
+  const double Q [2] = { 0.54119610, 1.3065630 };
+  const double w0 = 2 * PI * 0.45 / this->oversample; // just under nyquist
+  for (uint i = 0; i < 2; i++) {
+    const double alpha = sin(w0) / (2 * Q[i]);
+    const double a0 = 1 + alpha;
+    this->aa[i].b0 = float((1 - cos(w0)) / 2 / a0);
+    this->aa[i].b1 = float((1 - cos(w0))     / a0);
+    this->aa[i].b2 = float((1 - cos(w0)) / 2 / a0);
+    this->aa[i].a1 = float(-2 * cos(w0)      / a0);
+    this->aa[i].a2 = float((1 - alpha)       / a0);
+    this->aa[i].z1 = 0;
+    this->aa[i].z2 = 0;
+  }
+}
+
+uint FilterChain::process(float* samples, uint len) {
+  float hi_90_x  = this->hi_90.x,  hi_90_y  = this->hi_90.y;
+  float hi_440_x = this->hi_440.x, hi_440_y = this->hi_440.y;
+  float lo_14k_y = this->lo_14k.y;
+
+  const float hi_90_a  = this->hi_90.a;
+  const float hi_440_a = this->hi_440.a;
+  const float lo_14k_a = this->lo_14k.a;
+
+  const auto chain = [&](float x) {
+    hi_90_y  = hi_90_a  * (hi_90_y  + x       - hi_90_x);  hi_90_x  = x;
+    hi_440_y = hi_440_a * (hi_440_y + hi_90_y - hi_440_x); hi_440_x = hi_90_y;
+    lo_14k_y = lo_14k_y + lo_14k_a * (hi_440_y - lo_14k_y);
+    return lo_14k_y;
+  };
+
+  uint out = 0;
+
+  if (this->oversample == 1) {
+    for (uint i = 0; i < len; i++)
+      samples[i] = chain(samples[i]);
+    out = len;
+  } else {
+    Biquad f0 = this->aa[0];
+    Biquad f1 = this->aa[1];
+    uint phase = this->phase;
+
+    for (uint i = 0; i < len; i++) {
+      float x = samples[i];
+
+      float y = f0.b0 * x + f0.z1;
+      f0.z1 = f0.b1 * x - f0.a1 * y + f0.z2;
+      f0.z2 = f0.b2 * x - f0.a2 * y;
+      x = y;
+
+      y = f1.b0 * x + f1.z1;
+      f1.z1 = f1.b1 * x - f1.a1 * y + f1.z2;
+      f1.z2 = f1.b2 * x - f1.a2 * y;
+
+      // decimate (writing behind the read position, so in-place is fine)
+      if (phase == 0) samples[out++] = chain(y);
+      if (++phase == this->oversample) phase = 0;
+    }
+
+    this->aa[0] = f0;
+    this->aa[1] = f1;
+    this->phase = phase;
+  }
+
+  this->hi_90  = { hi_90_a,  hi_90_x,  hi_90_y  };
+  this->hi_440 = { hi_440_a, hi_440_x, hi_440_y };
+  this->lo_14k.y = lo_14k_y;
+
+  return out;
+}
@@ -4,58 +4,45 @@
 
 // idk what i'm doing, but wikipedia is nice enough to give some sample
 // code, so I think these work alright
+// https://en.wikipedia.org/wiki/High-pass_filter
+// https://en.wikipedia.org/wiki/Low-pass_filter
 
 typedef uint hertz;
 
-class FirstOrderFilter {
-protected:
-  const double RC, dt;
-public:
-  virtual double process(double sample) = 0;
+// APU output filter chain
+// The NES's audio output goes through a couple of first-order filters: two
+// hi-pass filters (90Hz and 440Hz) and a lo-pass filter (14kHz). Instead of
+// running each filter on its own, sample by sample, the chain is fused into a
+// single loop over a whole block of samples, with its state in locals.
+//
+// When the APU is synthesizing at some multiple of the output rate (i.e:
+// oversampling), the block first goes through a 4th order Butterworth lo-pass
+// (a pair of biquads) to cut out anything above the output's nyquist, and then
+// gets decimated down to the output rate.
+class FilterChain {
+private:
+  uint oversample;
 
-  virtual ~FirstOrderFilter() = default;
-  FirstOrderFilter(hertz f, hertz sample_rate)
-  : RC { 1.0 / (2 * 3.1415928535 * double(f)) }
-  , dt { 1.0 / double(sample_rate) }
-  {}
-};
+  // First-order filters (run at the output rate)
+  struct {
+    float a; // coefficient
+    float x, y; // previous input / output
+  } hi_90, hi_440, lo_14k;
 
-// https://en.wikipedia.org/wiki/Low-pass_filter
-class LoPassFilter final : public FirstOrderFilter {
-private:
-  const double a;
-  struct { double x, y; } prev;
-public:
-  virtual ~LoPassFilter() = default;
-  LoPassFilter(hertz f, hertz sample_rate)
-  : FirstOrderFilter(f, sample_rate)
-  , a { this->dt / (this->RC + this->dt) }
-  , prev { 0, 0 }
-  {}
-
-  double process(double x) override {
-    double y = this->a * x + (1 - this->a) * this->prev.y;
-    this->prev = { x, y };
-    return y;
-  }
-};
+  // Anti-aliasing biquads (run at the oversampled rate)
+  struct Biquad {
+    float b0, b1, b2, a1, a2; // coefficients (normalized, a0 = 1)
+    float z1, z2;             // state (transposed direct form II)
+  } aa [2];
+
+  uint phase; // samples until the next one is kept (when decimating)
 
-// https://en.wikipedia.org/wiki/High-pass_filter
-class HiPassFilter final : public FirstOrderFilter {
-private:
-  const double a;
-  struct { double x, y; } prev;
 public:
-  virtual ~HiPassFilter() = default;
-  HiPassFilter(hertz f, hertz sample_rate)
-  : FirstOrderFilter(f, sample_rate)
-  , a { this->RC / (this->RC + this->dt) }
-  , prev { 0, 0 }
-  {}
-
-  double process(double x) override {
-    double y = this->a * this->prev.y + this->a * (x - this->prev.x);
-    this->prev = { x, y };
-    return y;
-  }
+  FilterChain(hertz sample_rate, uint oversample);
+
+  uint get_oversample() const { return this->oversample; }
+
+  // Filters `len` samples in-place, returning how many samples are left once
+  // decimated (i.e: len / oversample, give or take one)
+  uint process(float* samples, uint len);
 };
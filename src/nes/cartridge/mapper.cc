@@ -1,5 +1,8 @@
 #include "mapper.h"
 
+#include "nes/ppu/ppu.h"
+#include "nes/wiring/ppu_mmu.h"
+
 /*--------------------------------  Helpers  ---------------------------------*/
 
 void Mapper::init_prg_banks(const ROM_File& rom_file, const u16 size) {
@@ -24,8 +27,12 @@ void Mapper::init_chr_banks(const ROM_File& rom_file, const u16 size) {
     this->banks.chr.len = rom_file.rom.chr.len / size;
   }
 
+  this->banks.chr.size = size;
   this->banks.chr.bank = new Memory* [this->banks.chr.len];
 
+  this->chr_cache.len = this->banks.chr.len * size / 0x400;
+  this->chr_cache.page = new ChrPage* [this->chr_cache.len] ();
+
   fprintf(stderr, "[Mapper] # %2uK CHR Banks: %u\n",
     size / 1024, this->banks.chr.len);
 
@@ -57,6 +64,73 @@ Memory& Mapper::get_chr_bank(uint bank) const {
   return *this->banks.chr.bank[bank % this->banks.chr.len];
 }
 
+void Mapper::set_cpu_pages(PageTable* cpu_pages) {
+  this->cpu_pages = cpu_pages;
+  if (this->cpu_pages)
+    this->cpu_pages->copy(this->prg_pages, 0x4000, 0xC000);
+}
+
+void Mapper::set_ppu_mmu(PPU_MMU* ppu_mmu) {
+  this->ppu_mmu = ppu_mmu;
+  this->update_mirroring();
+}
+
+void Mapper::update_mirroring() {
+  if (this->ppu_mmu)
+    this->ppu_mmu->set_mirroring(this->mirroring());
+}
+
+uint Mapper::ppu_cycles_until_a12_rises(uint n) const {
+  return this->ppu ? this->ppu->cycles_until_a12_rises(n) : 0;
+}
+
+void Mapper::map_prg_rom(u16 addr, uint len, const ROM& rom) {
+  this->prg_pages.map(addr, len, rom.data(), nullptr, /* is_rom */ true);
+  if (this->cpu_pages)
+    this->cpu_pages->copy(this->prg_pages, addr, len);
+}
+
+void Mapper::map_prg_ram(
+  u16 addr, uint len,
+  RAM& ram,
+  bool readable, bool writable
+) {
+  this->prg_pages.map(addr, len,
+    readable ? ram.data() : nullptr,
+    writable ? ram.data() : nullptr
+  );
+  if (this->cpu_pages)
+    this->cpu_pages->copy(this->prg_pages, addr, len);
+}
+
+void Mapper::unmap_prg(u16 addr, uint len) {
+  this->prg_pages.unmap(addr, len);
+  if (this->cpu_pages)
+    this->cpu_pages->copy(this->prg_pages, addr, len);
+}
+
+void Mapper::map_chr(u16 addr, uint len, uint bank) {
+  assert(len <= this->banks.chr.size);
+  bank %= this->banks.chr.len;
+
+  for (uint i = 0; i < len / 0x400; i++) {
+    ChrPage*& page = this->chr_cache.page[bank * (this->banks.chr.size / 0x400) + i];
+    if (!page) {
+      page = new ChrPage;
+      page->mem    = this->banks.chr.bank[bank];
+      page->offset = i * 0x400;
+      page->dirty  = ~u64(0);
+    }
+    this->chr_table.map(addr + i * 0x400, page);
+  }
+}
+
+void Mapper::invalidate_chr() {
+  for (uint i = 0; i < this->chr_cache.len; i++)
+    if (this->chr_cache.page[i])
+      this->chr_cache.page[i]->dirty = ~u64(0);
+}
+
 uint Mapper::get_prg_bank_len() const {
   return this->banks.prg.len;
 }
@@ -75,6 +149,10 @@ Mapper::~Mapper() {
   for (uint i = 0; i < this->banks.chr.len; i++)
     delete this->banks.chr.bank[i];
   delete[] this->banks.chr.bank;
+
+  for (uint i = 0; i < this->chr_cache.len; i++)
+    delete this->chr_cache.page[i];
+  delete[] this->chr_cache.page;
 }
 
 Mapper::Mapper(
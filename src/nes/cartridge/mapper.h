@@ -1,5 +1,7 @@
 #pragma once
 
+#include <climits>
+
 #include "common/util.h"
 #include "nes/generic/ram/ram.h"
 #include "nes/generic/rom/rom.h"
@@ -7,11 +9,16 @@
 #include "nes/interfaces/mirroring.h"
 #include "rom_file.h"
 
+#include "nes/wiring/chr_cache.h"
 #include "nes/wiring/interrupt_lines.h"
+#include "nes/wiring/page_table.h"
 
 #include "common/callback_manager.h"
 #include "common/serializable.h"
 
+class PPU;
+class PPU_MMU;
+
 // Base Mapper Interface
 // Implements common mapper utilities (eg: bank-chunking, IRQ handling)
 // At minimum, Mappers must implement the following methods:
@@ -22,7 +29,11 @@
 // The following virtual methods implement default behaviors:
 //   - read ................. calls peek
 //   - get/setBatterySave ... get returns nullptr, set does nothing
-//   - cycle ................ does nothing
+//   - timing ............... returns Timing::NONE (so no timing hooks are run)
+//   - cpu_cycle ............ does nothing
+//   - ppu_a12_rise ......... does nothing
+//   - scanline ............. does nothing
+//   - four_screen_vram ..... returns nullptr
 //   - power_cycle .......... clears CHR RAM, and calls reset + update_banks
 class Mapper : public Memory, public Serializable {
 private:
@@ -34,6 +45,21 @@ private:
 
   // Wiring
   InterruptLines* interrupt_line = nullptr;
+  PageTable*      cpu_pages      = nullptr;
+  PPU_MMU*        ppu_mmu        = nullptr;
+  const PPU*      ppu            = nullptr;
+
+  // Mapper's own copy of it's direct CPU mappings, which get applied to the
+  // CPU's page table whenever the cartridge is (re)inserted
+  PageTable prg_pages;
+
+  // Decoded CHR pages (allocated on first use), and the ones currently mapped
+  // into pattern table space (see nes/wiring/chr_cache.h)
+  struct {
+    uint      len;
+    ChrPage** page;
+  } chr_cache;
+  ChrTable chr_table;
 
   // Banks
   struct {
@@ -45,6 +71,7 @@ private:
     struct {
       bool is_RAM = false;
       uint len;
+      uint size;
       Memory** bank;
     } chr;
   } banks;
@@ -67,6 +94,7 @@ protected:
 
   virtual const Serializable::Chunk* deserialize(const Serializable::Chunk* c) override {
     c = this->Serializable::deserialize(c);
+    this->invalidate_chr();
     this->update_banks();
     return c;
   }
@@ -77,6 +105,8 @@ private:
   void init_prg_banks(const ROM_File& rom_file, const u16 size);
   void init_chr_banks(const ROM_File& rom_file, const u16 size);
 
+  void invalidate_chr(); // CHR RAM contents changed wholesale
+
   /*-----------------  Common Mapper Functions / Services  -------------------*/
 
 protected:
@@ -88,6 +118,27 @@ protected:
   ROM&    get_prg_bank(uint bank) const;
   Memory& get_chr_bank(uint bank) const;
 
+  // Direct CPU mappings (see nes/wiring/page_table.h)
+  // Mappers should (re)map any side-effect free PRG memory in update_banks().
+  // Unmapped ranges are always accessed through read / peek / write.
+  void map_prg_rom(u16 addr, uint len, const ROM& rom);
+  void map_prg_ram(u16 addr, uint len, RAM& ram, bool readable, bool writable);
+  void unmap_prg(u16 addr, uint len);
+
+  // Decoded CHR mappings (see nes/wiring/chr_cache.h)
+  // Mappers should (re)map all of 0x0000 ... 0x1FFF in update_banks(), using
+  // the same bank numbers as get_chr_bank(). `len` can't exceed the bank size.
+  void map_chr(u16 addr, uint len, uint bank);
+
+  // Nametable mirroring is pushed to the PPU MMU, instead of being queried on
+  // every nametable access. Mappers with switchable mirroring should call this
+  // in update_banks().
+  void update_mirroring();
+
+  // PPU cycles until the n'th rising edge of PPU A12 from rendering, for
+  // mappers that count them (see PPU::cycles_until_a12_rises)
+  uint ppu_cycles_until_a12_rises(uint n) const;
+
   /*--------------------------  External Interface  --------------------------*/
 
 public:
@@ -102,6 +153,16 @@ public:
   void set_interrupt_line(InterruptLines* interrupt_line) {
     this->interrupt_line = interrupt_line;
   }
+  void set_cpu_pages(PageTable* cpu_pages);
+  void set_ppu_mmu(PPU_MMU* ppu_mmu);
+  void set_ppu(const PPU* ppu) { this->ppu = ppu; }
+
+  // Decoded tiles currently mapped into pattern table space
+  const ChrTable& chr_tiles() const { return this->chr_table; }
+  // Should be called after pattern table memory is written to
+  void chr_written(u16 addr) {
+    if (this->banks.chr.is_RAM) this->chr_table.invalidate(addr);
+  }
 
   // ---- Mapper Queries ---- //
   const char* mapper_name()   const { return this->name;   };
@@ -122,8 +183,29 @@ public:
   virtual void write(u16 addr, u8 val) override = 0;
 
   virtual Mirroring::Type mirroring() const = 0; // Get mirroring mode
-
-  virtual void cycle() {}
+  // Extra nametable VRAM on the cart (4K, only used by FourScreen mirroring)
+  virtual u8* four_screen_vram() { return nullptr; }
+
+  // ---- Timing Hooks ---- //
+  // Most mappers don't care about timing at all, so instead of calling every
+  // hook on every cycle, the NES only calls the hooks a mapper asks for
+  // (queried once, when the cartridge is loaded).
+  struct Timing { enum Flags : uint {
+    NONE      = 0,
+    CPU_CYCLE = 1 << 0, // cpu_cycle()    - once per CPU cycle
+    PPU_A12   = 1 << 1, // ppu_a12_rise() - on PPU A12 rising edges (CHR reads)
+    SCANLINE  = 1 << 2, // scanline()     - at the end of every PPU scanline
+  }; };
+  virtual uint timing() const { return Timing::NONE; }
+
+  virtual void cpu_cycle()    {}
+  virtual void ppu_a12_rise() {}
+  virtual void scanline()     {}
+
+  // Number of (PPU) cycles until the mapper might fire an IRQ, counted from
+  // where the PPU is (i.e: regardless of lag).
+  // Might be too early, but never too late.
+  virtual uint cycles_until_irq() const { return UINT_MAX; }
 
   virtual void power_cycle() {
     // NOTE: there are a couple of boards that have battery-backed CHR RAM.
@@ -134,6 +216,7 @@ public:
       for (uint j = 0; j < this->banks.chr.len; j++) {
         static_cast<RAM*>(this->banks.chr.bank[j])->clear();
       }
+      this->invalidate_chr();
     }
     this->reset();
     this->update_banks();
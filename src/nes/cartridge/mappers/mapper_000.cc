@@ -34,5 +34,9 @@ void Mapper_000::update_banks() {
   this->prg_lo = &this->get_prg_bank(0);
   this->prg_hi = &this->get_prg_bank(1); // Same as bank 0 when only 16K PRG ROM
 
+  this->map_prg_rom(0x8000, 0x4000, *this->prg_lo);
+  this->map_prg_rom(0xC000, 0x4000, *this->prg_hi);
+
   this->chr_mem = &this->get_chr_bank(0);
+  this->map_chr(0x0000, 0x2000, 0);
 }
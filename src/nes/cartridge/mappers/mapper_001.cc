@@ -41,8 +41,9 @@ void Mapper_001::write(u16 addr, u8 val) {
 
   // Otherwise, handle writing to registers
 
+  // Writes on consecutive CPU cycles (e.g: RMW instructions) are ignored
   if (this->write_just_happened) return;
-  this->write_just_happened = 6;
+  this->write_just_happened = 2;
 
   // "Unlike almost all other mappers, the MMC1 is configured through a serial
   //  port in order to reduce pin count." - Wiki
@@ -112,16 +113,29 @@ void Mapper_001::update_banks() {
     break;
   }
 
+  this->map_prg_rom(0x8000, 0x4000, *this->prg_lo);
+  this->map_prg_rom(0xC000, 0x4000, *this->prg_hi);
+
+  // 0 means RAM is _enabled_
+  const bool ram_enabled = this->reg.prg.ram_enable == 0;
+  this->map_prg_ram(0x6000, 0x2000, this->prg_ram, ram_enabled, ram_enabled);
+
   // Update CHR Banks
   if (this->reg.control.chr_bank_mode == 0) {
     // switch 8 KB at a time (ignoring low bit)
     this->chr_lo = &this->get_chr_bank(this->reg.chr0.bank & 0xFE);
     this->chr_hi = &this->get_chr_bank(this->reg.chr0.bank | 0x01);
+    this->map_chr(0x0000, 0x1000, this->reg.chr0.bank & 0xFE);
+    this->map_chr(0x1000, 0x1000, this->reg.chr0.bank | 0x01);
   } else {
     // switch two separate 4 KB banks
     this->chr_lo = &this->get_chr_bank(this->reg.chr0.bank);
     this->chr_hi = &this->get_chr_bank(this->reg.chr1.bank);
+    this->map_chr(0x0000, 0x1000, this->reg.chr0.bank);
+    this->map_chr(0x1000, 0x1000, this->reg.chr1.bank);
   }
+
+  this->update_mirroring();
 }
 
 Mirroring::Type Mapper_001::mirroring() const {
@@ -139,7 +153,7 @@ Mirroring::Type Mapper_001::mirroring() const {
   }
 }
 
-void Mapper_001::cycle() {
+void Mapper_001::cpu_cycle() {
   if (this->write_just_happened)
     this->write_just_happened--;
 }
@@ -105,7 +105,8 @@ public:
 
   Mirroring::Type mirroring() const override;
 
-  void cycle() override;
+  uint timing() const override { return Timing::CPU_CYCLE; }
+  void cpu_cycle() override;
 
   const Serializable::Chunk* getBatterySave() const override {
     return this->prg_ram.serialize();
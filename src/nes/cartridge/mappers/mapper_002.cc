@@ -42,7 +42,11 @@ void Mapper_002::update_banks() {
   this->prg_lo = &this->get_prg_bank(this->reg.bank_select);
   this->prg_hi = &this->get_prg_bank(this->get_prg_bank_len() - 1); // Fixed
 
+  this->map_prg_rom(0x8000, 0x4000, *this->prg_lo);
+  this->map_prg_rom(0xC000, 0x4000, *this->prg_hi);
+
   this->chr_mem = &this->get_chr_bank(0);
+  this->map_chr(0x0000, 0x2000, 0);
 }
 
 void Mapper_002::reset() {
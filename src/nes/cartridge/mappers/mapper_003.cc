@@ -42,7 +42,11 @@ void Mapper_003::update_banks() {
   this->prg_lo = &this->get_prg_bank(0);
   this->prg_hi = &this->get_prg_bank(1);
 
+  this->map_prg_rom(0x8000, 0x4000, *this->prg_lo);
+  this->map_prg_rom(0xC000, 0x4000, *this->prg_hi);
+
   this->chr_mem = &this->get_chr_bank(this->reg.bank_select);
+  this->map_chr(0x0000, 0x2000, this->reg.bank_select);
 }
 
 void Mapper_003::reset() {
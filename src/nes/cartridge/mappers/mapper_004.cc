@@ -22,62 +22,12 @@ Mapper_004::~Mapper_004() {
     delete four_screen_ram;
 }
 
-u8 Mapper_004::read(u16 addr) {
-  // Wired to the PPU MMU
-  if (in_range(addr, 0x0000, 0x1FFF)) {
-    // The MMC3 scanline counter is based entirely on PPU A12,
-    // being clocked on A12's rising edge
-    bool next = nth_bit(addr, 12);
-    if (this->last_A12 == 0 && next == 1) { // Rising Edge
-      if (this->reg.irq_counter == 0) {
-        this->reg.irq_counter = this->reg.irq_latch;
-      } else {
-        this->reg.irq_counter--;
-      }
-
-      if (this->reg.irq_counter == 0) {
-        if (this->reg.irq_enabled)
-          this->irq_trigger();
-
-        _did_irq_callbacks.run(this, this->reg.irq_enabled);
-      }
-    }
-    this->last_A12 = next;
-
-    return this->chr_bank[addr / 0x400]->read(addr % 0x400);
-  }
-
-  // 4 Screen RAM
-  if (in_range(addr, 0x2000, 0x2FFF)) {
-    assert(this->four_screen_ram);
-    return this->four_screen_ram->read(addr - 0x2000);
-  }
-
-  // Wired to the CPU MMU
-  if (in_range(addr, 0x4020, 0x5FFF)) return 0x00; // Nothing in "Expansion ROM"
-  if (in_range(addr, 0x6000, 0x7FFF)) return this->reg.ram_protect.enable_ram
-                                           ? this->prg_ram.read(addr - 0x6000)
-                                           : 0x00; // should be open bus...
-  if (in_range(addr, 0x8000, 0xFFFF)) {
-    return this->prg_bank[(addr - 0x8000) / 0x2000]->read(addr % 0x2000);
-  }
-
-  assert(false);
-  return 0x00;
-}
-
 u8 Mapper_004::peek(u16 addr) const {
   // Wired to the PPU MMU
   if (in_range(addr, 0x0000, 0x1FFF)) {
     return this->chr_bank[addr / 0x400]->peek(addr % 0x400);
   }
 
-  // 4 Screen RAM
-  if (in_range(addr, 0x2000, 0x2FFF)) {
-    assert(this->four_screen_ram);
-    return this->four_screen_ram->peek(addr - 0x2000);
-  }
-
   // Wired to the CPU MMU
   if (in_range(addr, 0x4020, 0x5FFF)) return 0x00; // Nothing in "Expansion ROM"
   if (in_range(addr, 0x6000, 0x7FFF)) return this->reg.ram_protect.enable_ram
@@ -96,11 +46,6 @@ void Mapper_004::write(u16 addr, u8 val) {
     // CHR might be RAM (potentially)
     return this->chr_bank[addr / 0x400]->write(addr % 0x400, val);
   }
-  // 4 Screen RAM
-  if (in_range(addr, 0x2000, 0x2FFF)) {
-    assert(this->four_screen_ram);
-    return this->four_screen_ram->write(addr - 0x2000, val);
-  }
   if (in_range(addr, 0x4020, 0x5FFF)) return; // do nothing to expansion ROM
   if (in_range(addr, 0x6000, 0x7FFF)) {
     (this->reg.ram_protect.write_enable == 0)
@@ -143,9 +88,15 @@ void Mapper_004::update_banks() {
   }
   #undef PBANK
 
+  for (uint i = 0; i < 4; i++)
+    this->map_prg_rom(0x8000 + i * 0x2000, 0x2000, *this->prg_bank[i]);
+
+  this->update_prg_ram();
+
   // https://wiki.nesdev.com/w/index.php/MMC3#CHR_Banks
   #define CBANK(i, val) \
-    this->chr_bank[i] = &this->get_chr_bank(val);
+    this->chr_bank[i] = &this->get_chr_bank(val); \
+    this->map_chr(i * 0x400, 0x400, val);
   if (this->reg.bank_select.chr_inversion == 0) {
     CBANK(0, this->reg.bank_values[0] & 0xFE);
     CBANK(1, this->reg.bank_values[0] | 0x01);
@@ -166,6 +117,23 @@ void Mapper_004::update_banks() {
     CBANK(7, this->reg.bank_values[1] | 0x01);
   }
   #undef CBANK
+
+  this->update_mirroring();
+}
+
+void Mapper_004::ppu_a12_rise() {
+  if (this->reg.irq_counter == 0) {
+    this->reg.irq_counter = this->reg.irq_latch;
+  } else {
+    this->reg.irq_counter--;
+  }
+
+  if (this->reg.irq_counter == 0) {
+    if (this->reg.irq_enabled)
+      this->irq_trigger();
+
+    _did_irq_callbacks.run(this, this->reg.irq_enabled);
+  }
 }
 
 Mirroring::Type Mapper_004::mirroring() const {
@@ -177,11 +145,14 @@ Mirroring::Type Mapper_004::mirroring() const {
     : Mirroring::Vertical;
 }
 
-void Mapper_004::power_cycle() {
-  this->last_A12 = false;
-  Mapper::power_cycle();
-}
-
 void Mapper_004::reset() {
   memset((char*)&this->reg, 0, sizeof this->reg);
+  this->update_prg_ram(); // RAM enable / protect bits were just reset
+}
+
+void Mapper_004::update_prg_ram() {
+  this->map_prg_ram(0x6000, 0x2000, this->prg_ram,
+    /* readable */ this->reg.ram_protect.enable_ram,
+    /* writable */ this->reg.ram_protect.write_enable == 0
+  );
 }
@@ -131,13 +131,11 @@ private:
 
   // ---- Emulation Vars and Helpers ---- //
 
-  bool last_A12 = false; // bit 12 of last CHR Memory read, used for IRQ
-
   bool fourscreen_mirroring = false;
 
   void update_banks() override;
+  void update_prg_ram(); // remaps PRG RAM according to RAM protect bits
 
-  void power_cycle() override;
   void reset() override;
 
   SERIALIZE_PARENT(Mapper)
@@ -152,12 +150,31 @@ public:
   ~Mapper_004();
 
   // <Memory>
-  u8 read(u16 addr)       override;
   u8 peek(u16 addr) const override;
   void write(u16 addr, u8 val) override;
   // <Memory/>
 
   Mirroring::Type mirroring() const override;
+  u8* four_screen_vram() override {
+    return this->four_screen_ram ? this->four_screen_ram->data() : nullptr;
+  }
+
+  // The MMC3 scanline counter is based entirely on PPU A12, being clocked on
+  // A12's rising edge
+  uint timing() const override { return Timing::PPU_A12; }
+  void ppu_a12_rise() override;
+
+  // IRQs are clocked by PPU A12 edges, which come at a predictable dot with
+  // the usual pattern table layout (see PPU::cycles_until_a12_rises)
+  uint cycles_until_irq() const override {
+    if (!this->reg.irq_enabled) return UINT_MAX;
+
+    // A zero counter is reloaded by the next edge, instead of being decremented
+    const uint rises = this->reg.irq_counter
+      ? this->reg.irq_counter
+      : this->reg.irq_latch + 1;
+    return this->ppu_cycles_until_a12_rises(rises);
+  }
 
   const Serializable::Chunk* getBatterySave() const override {
     return this->prg_ram.serialize();
@@ -48,7 +48,13 @@ void Mapper_007::update_banks() {
   this->prg_lo = &this->get_prg_bank(this->reg.bank_select.prg_bank * 2 + 0);
   this->prg_hi = &this->get_prg_bank(this->reg.bank_select.prg_bank * 2 + 1);
 
+  this->map_prg_rom(0x8000, 0x4000, *this->prg_lo);
+  this->map_prg_rom(0xC000, 0x4000, *this->prg_hi);
+
   this->chr_mem = &this->get_chr_bank(0);
+  this->map_chr(0x0000, 0x2000, 0);
+
+  this->update_mirroring();
 }
 
 void Mapper_007::reset() {
@@ -19,7 +19,7 @@ u8 Mapper_009::read(u16 addr) {
   ) {
     const u8 retval = this->peek(addr); // latch only updated _after_ read
     this->reg.latch[!!(addr & 0x1000)] = ((addr & 0x0FF0) >> 4) == 0xFE;
-    this->update_banks();
+    this->update_chr_banks();
     return retval;
   }
 
@@ -72,11 +72,24 @@ void Mapper_009::update_banks() {
   this->prg_rom[2] = &this->get_prg_bank(this->get_prg_bank_len() - 2);
   this->prg_rom[3] = &this->get_prg_bank(this->get_prg_bank_len() - 1);
 
-  // Update CHR Banks
+  for (uint i = 0; i < 4; i++)
+    this->map_prg_rom(0x8000 + i * 0x2000, 0x2000, *this->prg_rom[i]);
+  this->map_prg_ram(0x6000, 0x2000, this->prg_ram, true, true);
+
+  this->update_chr_banks();
+
+  this->update_mirroring();
+}
+
+void Mapper_009::update_chr_banks() {
   this->chr_rom.lo[0] = &this->get_chr_bank(this->reg.chr.lo[0].bank);
   this->chr_rom.lo[1] = &this->get_chr_bank(this->reg.chr.lo[1].bank);
   this->chr_rom.hi[0] = &this->get_chr_bank(this->reg.chr.hi[0].bank);
   this->chr_rom.hi[1] = &this->get_chr_bank(this->reg.chr.hi[1].bank);
+
+  // The latches pick which of the two banks is actually visible
+  this->map_chr(0x0000, 0x1000, this->reg.chr.lo[this->reg.latch[0]].bank);
+  this->map_chr(0x1000, 0x1000, this->reg.chr.hi[this->reg.latch[1]].bank);
 }
 
 Mirroring::Type Mapper_009::mirroring() const {
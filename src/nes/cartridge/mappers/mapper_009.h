@@ -63,6 +63,7 @@ private:
   } reg;
 
   void update_banks() override;
+  void update_chr_banks(); // (all that the latches can change)
 
   void reset() override;
 
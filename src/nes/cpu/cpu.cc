@@ -2,18 +2,37 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 
 /*-----------------------------  Public Methods  -----------------------------*/
 
-CPU::CPU(const NES_Params& params, Memory& mem, InterruptLines& interrupt)
+CPU::CPU(const NES_Params& params, CPU_MMU& mem, InterruptLines& interrupt,
+         CPUTrace& trace)
 : interrupt(interrupt)
 , mem(mem)
-, print_nestest(params.log_cpu)
+, use_decode_cache(params.cpu_decode_cache)
+, use_dynarec(params.cpu_dynarec)
+, skip_idle_loops(params.cpu_idle_loops)
+, log_cpu(params.log_cpu)
+, trace(trace)
 {
+  memset(&this->decode_cache, 0, sizeof this->decode_cache);
+  memset(&this->decode_cache_stats, 0, sizeof this->decode_cache_stats);
+  memset(&this->burst, 0, sizeof this->burst);
+  memset(&this->dynarec, 0, sizeof this->dynarec);
+  memset(&this->dynarec_stats, 0, sizeof this->dynarec_stats);
+  memset(&this->idle_loop, 0, sizeof this->idle_loop);
+  memset(&this->idle_loop_stats, 0, sizeof this->idle_loop_stats);
+
   this->power_cycle();
 }
 
+CPU::~CPU() {
+  this->flush_decode_cache();
+  this->dynarec_free();
+}
+
 // https://wiki.nesdev.com/w/index.php/CPU_power_up_state
 void CPU::power_cycle() {
   this->cycles = 0;
@@ -76,6 +95,8 @@ void CPU::service_interrupt(Interrupts::Type interrupt, bool brk /* = false */)
   this->interrupt.service(interrupt);
 }
 
+#ifdef CPU_SWITCH_INTERP
+
 u16 CPU::get_operand_addr(const Instructions::Opcode& opcode) {
   using namespace Instructions::AddrM;
 
@@ -129,28 +150,7 @@ u16 CPU::get_operand_addr(const Instructions::Opcode& opcode) {
   return addr;
 }
 
-uint CPU::step() {
-  uint old_cycles = this->cycles;
-
-  // Service pending interrupts
-  if (Interrupts::Type interrupt = this->interrupt.get()) {
-    this->service_interrupt(interrupt);
-    return this->cycles - old_cycles;
-  }
-
-  // Fetch current opcode
-  u8 op = this->mem[this->reg.pc++];
-
-  // Lookup info about opcode
-  Instructions::Opcode opcode = Instructions::Opcodes[op];
-
-  if (this->print_nestest) {
-    this->nestest(*this, opcode);
-  }
-#ifdef NESTEST
-  this->nestest(*this, opcode);
-#endif
-
+void CPU::exec_switch(const Instructions::Opcode& opcode) {
   u16 addr = this->get_operand_addr(opcode);
 
   using namespace Instructions::Instr;
@@ -402,9 +402,132 @@ uint CPU::step() {
   }
 
   this->cycles += opcode.cycles;
+}
+
+#endif // CPU_SWITCH_INTERP
+
+uint CPU::step() {
+  uint old_cycles = this->cycles;
+
+  // Service pending interrupts
+  if (Interrupts::Type interrupt = this->interrupt.get()) {
+    this->idle_loop.state = this->idle_loop.NONE;
+    this->service_interrupt(interrupt);
+    return this->cycles - old_cycles;
+  }
+
+#ifndef NESTEST
+  if (this->skip_idle_loops && !this->log_cpu) {
+    // Replay idle loops instead of executing them (see idle_loop.cc)
+    if (this->idle_loop.state == this->idle_loop.SKIPPING)
+      if (this->idle_loop_skip())
+        return this->cycles - old_cycles;
+
+    const u16 old_pc = this->reg.pc;
+
+    if (this->idle_loop.state == this->idle_loop.RECORDING) {
+      if (this->idle_loop_record_start()) {
+        this->exec_next();
+        this->idle_loop_record_end(this->cycles - old_cycles);
+        return this->cycles - old_cycles;
+      }
+    }
+
+    this->exec_next();
+
+    // Short backwards jumps might be idle loops
+    if (this->reg.pc <= old_pc)
+      this->idle_loop_detect(old_pc);
+
+    return this->cycles - old_cycles;
+  }
+#endif
+
+  this->exec_next();
+
   return this->cycles - old_cycles;
 }
 
+uint CPU::step_block(uint event_cycles) {
+#if !defined(CPU_SWITCH_INTERP) && !defined(NESTEST)
+  const bool can_burst = this->use_decode_cache
+    && !this->log_cpu
+    && event_cycles > 0
+    // pending interrupts have to be serviced first
+    && this->interrupt.get() == Interrupts::NONE
+    // idle loops are recorded / replayed by step (see idle_loop.cc)
+    && this->idle_loop.state == this->idle_loop.NONE;
+
+  if (can_burst) {
+    this->burst.start = this->cycles;
+    this->burst.budget = event_cycles;
+
+    do {
+      const uint old_cycles = this->cycles;
+      const u16 old_pc = this->reg.pc;
+
+      DynBlock block = this->use_dynarec ? this->dynarec_block(old_pc) : nullptr;
+      if (block) {
+        block(this);
+        if (this->cycles != old_cycles) {
+          this->dynarec_stats.runs++;
+          this->dynarec_stats.cycles += this->cycles - old_cycles;
+        }
+      } else if (const DecodedOp* decoded = this->decode(old_pc)) {
+        CPU::burst_op_handlers[decoded->op](this, decoded->arg);
+      }
+
+      // instruction has to go through the full interpreter
+      if (this->cycles == old_cycles) break;
+
+      // Short backwards jumps might be idle loops
+      if (this->skip_idle_loops && this->reg.pc <= old_pc) {
+        this->idle_loop_detect(old_pc);
+        if (this->idle_loop.state != this->idle_loop.NONE) break;
+      }
+    } while (this->cycles - this->burst.start < this->burst.budget);
+
+    if (const uint cycles = this->cycles - this->burst.start)
+      return cycles;
+  }
+#else
+  (void)event_cycles;
+#endif
+
+  return this->step();
+}
+
+void CPU::exec_next() {
+#ifdef NESTEST
+  char line [CPUTrace::FORMAT_LEN];
+  CPUTrace::format(this->trace_instr(), line);
+  printf("%s\n", line);
+#else
+  if (this->log_cpu)
+    this->trace_instr();
+#endif
+
+#if !defined(CPU_SWITCH_INTERP) && !defined(NESTEST)
+  // Try running a pre-decoded instruction
+  if (this->use_decode_cache) {
+    if (const DecodedOp* decoded = this->decode(this->reg.pc)) {
+      this->reg.pc += decoded->len;
+      (this->*decoded->handler)(decoded->arg);
+      return;
+    }
+  }
+#endif
+
+  // Fetch current opcode
+  u8 op = this->mem[this->reg.pc++];
+
+#ifdef CPU_SWITCH_INTERP
+  this->exec_switch(Instructions::Opcodes[op]);
+#else
+  (this->*op_handlers[op])();
+#endif
+}
+
 /*----------  Helpers  ----------*/
 
 u8   CPU::s_pull()       { return this->mem[0x0100 + ++this->reg.s]; }
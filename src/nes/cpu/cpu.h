@@ -4,8 +4,10 @@
 #include "common/serializable.h"
 #include "common/util.h"
 #include "instructions.h"
+#include "trace.h"
 #include "nes/interfaces/memory.h"
 
+#include "nes/wiring/cpu_mmu.h"
 #include "nes/wiring/interrupt_lines.h"
 
 #include "nes/params.h"
@@ -20,9 +22,11 @@ private:
 
   InterruptLines& interrupt;
 
-  Memory& mem; // Memory
+  // Concrete type (instead of Memory&), so that CPU_MMU's inlined page-table
+  // fast-path can be used for most accesses
+  CPU_MMU& mem;
 
-  struct { // Registers
+  struct Registers {
     // -- Special Registers -- //
     u16 pc; // Program Counter
     u8  s;  // Stack Pointer (offset from 0x0100)
@@ -56,9 +60,177 @@ private:
     SERIALIZE_POD(is_running)
   SERIALIZE_END(3)
 
-  /*--------------  Helpers  -------------*/
+  /*------------  Execution  ------------*/
 
+#ifdef CPU_SWITCH_INTERP
+  // Classic interpreter: decodes addressing mode + instruction at runtime
   u16 get_operand_addr(const Instructions::Opcode& opcode);
+  void exec_switch(const Instructions::Opcode& opcode);
+#endif
+
+  // Compile-time specialized opcode handlers (implemented in handlers.cc)
+  template <Instructions::AddrM::Type M>
+  u16 fetch_operand();
+  template <Instructions::AddrM::Type M, bool check_pg_cross>
+  u16 resolve_addr(u16 arg);
+  template <Instructions::AddrM::Type M, bool check_pg_cross>
+  u16 operand_addr();
+  template <Instructions::Instr::Type I, Instructions::AddrM::Type M>
+  void instr(u16 addr);
+  template <u8 op>
+  void exec();
+  template <u8 op>
+  void exec_decoded(u16 arg);
+
+  typedef void (CPU::*OpHandler)();
+  static const OpHandler op_handlers[256];
+  typedef void (CPU::*DecodedOpHandler)(u16 arg);
+  static const DecodedOpHandler decoded_op_handlers[256];
+
+  /*-----------  Decode Cache  -----------*/
+  // Caches pre-decoded instructions for every page of code the CPU runs,
+  // keyed by the memory backing that page (i.e: PRG bank identity), so that
+  // bank-switching doesn't throw out previously decoded code.
+  // (implemented in decode_cache.cc)
+
+  struct DecodedOp {
+    DecodedOpHandler handler; // nullptr if not decoded
+    u16 arg;                  // raw operand bytes
+    u8  op;                   // raw opcode byte
+    u8  len;                  // instruction length
+  };
+
+  typedef void (*DynBlock)(CPU* self); // compiled dynarec block
+
+  struct DecodedPage {
+    const u8*    mem;    // memory this page was decoded from
+    bool         is_rom; // entries in RAM pages are validated before use
+    DecodedPage* next;   // next page in hash bucket
+    DecodedOp    ops    [256];
+    DynBlock     blocks [256]; // dynarec blocks starting at each offset
+    u8           heat   [256]; // dynarec block entry counts
+  };
+
+  static constexpr uint DECODE_CACHE_BUCKETS   = 256;
+  static constexpr uint DECODE_CACHE_MAX_PAGES = 1024; // ~6MB worst case
+
+  struct {
+    DecodedPage* buckets [DECODE_CACHE_BUCKETS];
+    DecodedPage* current [256]; // last page used at each CPU page
+    uint         num_pages;
+  } decode_cache;
+
+  const bool& use_decode_cache;
+
+  const DecodedOp* decode(u16 pc);
+  DecodedPage* code_page(u16 pc);
+  DecodedPage* get_decoded_page(const u8* mem, bool is_rom);
+
+public:
+  struct DecodeCacheStats {
+    u64 hits;
+    u64 misses;
+  };
+
+private:
+  DecodeCacheStats decode_cache_stats;
+
+  /*--------------  Bursts  --------------*/
+  // step_block runs the CPU ahead of the rest of the NES, up until the next
+  // scheduled event, or until an instruction has to touch I/O.
+
+  // Per-instruction entry points for bursts (and compiled dynarec blocks).
+  // Return false to end the burst (see handlers.cc)
+  typedef bool (*BurstOpHandler)(CPU* self, u16 arg);
+  template <u8 op>
+  static bool burst_op(CPU* self, u16 arg);
+  static const BurstOpHandler burst_op_handlers[256];
+
+  template <Instructions::Instr::Type I, Instructions::AddrM::Type M>
+  bool is_direct(u16 arg) const;
+
+  struct {
+    uint start;  // CPU cycles when the current burst was started
+    uint budget; // CPU cycles the current burst may run for
+  } burst;
+
+  /*--------------  Dynarec  -------------*/
+  // Translates hot blocks of PRG ROM code into native x86-64 code, which runs
+  // a whole block's worth of instructions in a single call.
+  // (implemented in dynarec.cc)
+
+  static constexpr uint DYNAREC_CODE_SIZE  = 1024 * 1024;
+  static constexpr uint DYNAREC_MAX_OPS    = 64;
+  static constexpr u8   DYNAREC_HOT        = 8;    // entries before compiling
+  static constexpr u8   DYNAREC_NO_BLOCK   = 0xFF; // heat of uncompilable code
+
+  struct {
+    u8*  code;        // executable code buffer
+    uint code_len;    // bytes of code buffer in use
+    bool unsupported; // no way to run native code on this platform
+  } dynarec;
+
+  const bool& use_dynarec;
+
+  DynBlock dynarec_block(u16 pc); // nullptr if there's no block (yet)
+  DynBlock dynarec_compile(u16 pc);
+  void dynarec_free();
+
+public:
+  struct DynarecStats {
+    u64 compiled; // blocks compiled
+    u64 runs;     // blocks run
+    u64 cycles;   // CPU cycles spent in blocks
+  };
+
+private:
+  DynarecStats dynarec_stats;
+
+  /*----------  Idle Loop Skipping  ----------*/
+  // Recognizes short loops that poll memory until an interrupt (or vblank)
+  // comes along, and replays them without actually executing them.
+  // (implemented in idle_loop.cc)
+
+  static constexpr uint IDLE_LOOP_MAX_OPS   = 8;
+  static constexpr uint IDLE_LOOP_MAX_BYTES = 32; // max backwards jump
+
+  struct IdleLoopOp {
+    Registers regs;   // register state before the op
+    u16       addr;   // address read by the op
+    u8        val;    // value read by the op
+    bool      reads;  // does the op read memory?
+    u8        cycles; // cycles taken by the op
+  };
+
+  struct {
+    enum { NONE, RECORDING, SKIPPING } state;
+    u16        head;     // address of the first op in the loop
+    u16        rejected; // head of the last loop found not to be idle
+    uint       len;      // ops recorded
+    uint       pos;      // current op
+    uint       retries;  // times the recording didn't settle
+    IdleLoopOp ops [IDLE_LOOP_MAX_OPS];
+  } idle_loop;
+
+  const bool& skip_idle_loops;
+
+  bool idle_loop_skip();
+  bool idle_loop_record_start();
+  void idle_loop_record_end(uint cycles);
+  void idle_loop_detect(u16 old_pc);
+
+public:
+  struct IdleLoopStats {
+    u64 loops;  // idle loops detected
+    u64 cycles; // CPU cycles skipped
+  };
+
+private:
+  IdleLoopStats idle_loop_stats;
+
+  /*--------------  Helpers  -------------*/
+
+  void exec_next(); // fetch, decode, and execute the instruction at pc
 
   void service_interrupt(Interrupts::Type type, bool brk = false);
 
@@ -76,13 +248,16 @@ private:
   void write16(u16 addr, u8 val);
 
   /*-------------  Debug  --------------*/
-  const bool& print_nestest;
-  // nestest is implemented in nestest.cc
-  static void nestest(const CPU& cpu, const Instructions::Opcode& opcode);
+  const bool& log_cpu;
+  CPUTrace& trace;
+  // records the instruction at pc (implemented in trace.cc)
+  const CPUTrace::Record& trace_instr();
 
 public:
+  ~CPU();
   CPU() = delete;
-  CPU(const NES_Params& params, Memory& mem, InterruptLines& interrupt);
+  CPU(const NES_Params& params, CPU_MMU& mem, InterruptLines& interrupt,
+      CPUTrace& trace);
 
   void power_cycle();
   void reset();
@@ -90,4 +265,24 @@ public:
   bool isRunning() const { return this->is_running; }
 
   uint step(); // exec instruction, and return cycles taken
+
+  // Like step, but may run a whole burst of instructions, stopping once
+  // `event_cycles` cycles have elapsed (i.e: once the next interrupt / DMC
+  // stall / frame end might have happened), or right before an instruction
+  // that touches I/O (which has to see the rest of the NES caught up).
+  uint step_block(uint event_cycles);
+
+  // Should be called whenever the memory backing PRG might be freed / reused
+  // (e.g: when swapping cartridges)
+  void flush_decode_cache();
+  const DecodeCacheStats& getDecodeCacheStats() const {
+    return this->decode_cache_stats;
+  }
+  const DynarecStats& getDynarecStats() const {
+    return this->dynarec_stats;
+  }
+  const IdleLoopStats& getIdleLoopStats() const {
+    return this->idle_loop_stats;
+  }
+  void resetIdleLoopStats() { this->idle_loop_stats = IdleLoopStats(); }
 };
@@ -0,0 +1,122 @@
+#include "cpu.h"
+#include "instructions.h"
+
+#include <cstring>
+
+// Decode Cache
+//
+// Most code the CPU runs comes straight out of PRG ROM, and gets run over and
+// over again every frame. Instead of re-fetching and re-decoding every
+// instruction each time it's executed, instructions are decoded once, and
+// stashed away in a per-page table of DecodedOps (handler + operand bytes).
+//
+// Pages are keyed by the memory that backs them (as reported by the CPU_MMU's
+// page table), which means that:
+// - Bank-switching "invalidates" cached code for free (the backing changes)
+// - Switching back to a previously used bank re-uses it's decoded code
+//
+// Code running from RAM (WRAM, PRG RAM) can be modified at any time, so each
+// cached instruction in a RAM page is checked against memory before being run,
+// and re-decoded if it was overwritten.
+//
+// Only pages that are directly mapped in the page table are cached, which
+// guarantees that skipping the instruction / operand fetches (and the dummy
+// reads that go along with them) has no observable side-effects.
+
+CPU::DecodedPage* CPU::get_decoded_page(const u8* mem, bool is_rom) {
+  const uint bucket = (uintptr_t(mem) >> 8) % DECODE_CACHE_BUCKETS;
+
+  for (DecodedPage* p = this->decode_cache.buckets[bucket]; p; p = p->next)
+    if (p->mem == mem)
+      return p;
+
+  // Not decoded yet, so make a new page
+  if (this->decode_cache.num_pages == DECODE_CACHE_MAX_PAGES)
+    this->flush_decode_cache();
+
+  DecodedPage* page = new DecodedPage;
+  memset(page->ops,    0, sizeof page->ops);
+  memset(page->blocks, 0, sizeof page->blocks);
+  memset(page->heat,   0, sizeof page->heat);
+  page->mem = mem;
+  page->is_rom = is_rom;
+  page->next = this->decode_cache.buckets[bucket];
+
+  this->decode_cache.buckets[bucket] = page;
+  this->decode_cache.num_pages++;
+
+  return page;
+}
+
+CPU::DecodedPage* CPU::code_page(u16 pc) {
+  const PageTable& pages = this->mem.page_table();
+
+  const u8* mem = pages.read[pc >> 8];
+  if (!mem) return nullptr; // I/O page, can't be cached
+
+  DecodedPage*& page = this->decode_cache.current[pc >> 8];
+  if (!page || page->mem != mem)
+    page = this->get_decoded_page(mem, pages.is_rom[pc >> 8]);
+
+  return page;
+}
+
+const CPU::DecodedOp* CPU::decode(u16 pc) {
+  DecodedPage* page = this->code_page(pc);
+  if (!page) return nullptr;
+
+  const u8* mem = page->mem;
+  const uint offset = pc & 0xFF;
+  DecodedOp& decoded = page->ops[offset];
+
+  if (decoded.handler) {
+    const bool valid = page->is_rom || (
+      (                    mem[offset + 0] == decoded.op) &&
+      (decoded.len < 2 || mem[offset + 1] == u8(decoded.arg)) &&
+      (decoded.len < 3 || mem[offset + 2] == u8(decoded.arg >> 8))
+    );
+
+    if (valid) {
+      this->decode_cache_stats.hits++;
+      return &decoded;
+    }
+  }
+
+  this->decode_cache_stats.misses++;
+
+  const Instructions::Opcode& opcode = Instructions::Opcodes[mem[offset]];
+  const uint len = Instructions::instr_len(opcode.addrm);
+
+  // Leave invalid opcodes to the regular handlers, along with instructions
+  // whose operands (or dummy-read) spill over into the next page, which might
+  // not be mapped
+  const uint span = len < 2 ? 2 : len;
+  if (opcode.instr == Instructions::Instr::INVALID || offset + span > 0x100) {
+    decoded.handler = nullptr;
+    return nullptr;
+  }
+
+  decoded.handler = CPU::decoded_op_handlers[opcode.raw];
+  decoded.op      = opcode.raw;
+  decoded.len     = len;
+  decoded.arg     = (len > 1 ? mem[offset + 1]      : 0x00)
+                  | (len > 2 ? mem[offset + 2] << 8 : 0x00);
+
+  return &decoded;
+}
+
+void CPU::flush_decode_cache() {
+  for (uint i = 0; i < DECODE_CACHE_BUCKETS; i++) {
+    DecodedPage* p = this->decode_cache.buckets[i];
+    while (p) {
+      DecodedPage* next = p->next;
+      delete p;
+      p = next;
+    }
+  }
+
+  memset(&this->decode_cache, 0, sizeof this->decode_cache);
+
+  // compiled blocks are referenced from the (now deleted) pages
+  this->dynarec.code_len = 0;
+}
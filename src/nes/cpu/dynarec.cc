@@ -0,0 +1,179 @@
+#include "cpu.h"
+#include "instructions.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Dynarec
+//
+// Translates hot basic blocks of PRG ROM code into x86-64 machine code.
+//
+// Blocks are "call-threaded": the generated code is a straight-line sequence
+// of calls into the CPU's per-opcode `burst_op` handlers (with the operand
+// bytes baked in as immediates), which strips out all of the fetch / decode /
+// dispatch overhead between instructions.
+//
+// Blocks are run as part of a regular burst (see CPU::step_block), so they
+// stay in sync with the rest of the NES the same way: each instruction checks
+// that it's data accesses don't touch I/O (PPU / APU registers, mapper
+// registers, etc...), and the block is exited _before_ executing one that
+// does, or as soon as the burst's cycle budget is used up.
+//
+// Since only PRG ROM pages are compiled, blocks never have to be invalidated
+// (and just like the decode cache, bank-switching is "free").
+
+#if defined(__x86_64__) && !defined(_WIN32)
+  #define DYNAREC_X64 // System V calling convention
+  #include <sys/mman.h>
+#endif
+
+/*-----------------------------  Code Emitter  -------------------------------*/
+
+namespace {
+
+struct Emitter {
+  u8*  code;
+  uint len;
+
+  void u8_ (u8  val) { this->code[this->len++] = val; }
+  void u32_(u32 val) { memcpy(this->code + this->len, &val, 4); this->len += 4; }
+  void u64_(u64 val) { memcpy(this->code + this->len, &val, 8); this->len += 8; }
+};
+
+// Worst-case size of a block
+constexpr uint PROLOGUE_LEN = 4;  // push rbx; mov rbx, rdi
+constexpr uint OP_LEN       = 28; // see below
+constexpr uint EPILOGUE_LEN = 2;  // pop rbx; ret
+
+} // namespace
+
+/*----------------------------  Block Compiler  ------------------------------*/
+
+static bool ends_block(Instructions::Instr::Type instr) {
+  using namespace Instructions::Instr;
+  switch (instr) {
+  case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC:
+  case BVS: case JMP: case JSR: case RTI: case RTS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+CPU::DynBlock CPU::dynarec_compile(u16 pc) {
+#ifdef DYNAREC_X64
+  if (!this->dynarec.code) {
+    void* code = mmap(nullptr, DYNAREC_CODE_SIZE,
+      PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1, 0
+    );
+    if (code == MAP_FAILED) {
+      fprintf(stderr, "[CPU] Could not allocate dynarec code buffer! "
+                      "Falling back to interpreter.\n");
+      this->dynarec.unsupported = true;
+      return nullptr;
+    }
+    this->dynarec.code = (u8*)code;
+  }
+
+  const uint max_len = PROLOGUE_LEN + OP_LEN * DYNAREC_MAX_OPS + EPILOGUE_LEN;
+  if (this->dynarec.code_len + max_len > DYNAREC_CODE_SIZE) {
+    // Out of space, so start over (along with the decoded pages that point
+    // into the code buffer)
+    this->flush_decode_cache();
+    return nullptr;
+  }
+
+  Emitter e = { this->dynarec.code + this->dynarec.code_len, 0 };
+
+  // The CPU* is kept in rbx (callee-saved) between calls.
+  // Pushing it also leaves the stack 16-byte aligned for the calls below.
+  e.u8_(0x53);                         // push rbx
+  e.u8_(0x48); e.u8_(0x89); e.u8_(0xFB); // mov rbx, rdi
+
+  uint exits [DYNAREC_MAX_OPS]; // offsets of rel32s that jump to the epilogue
+  uint num_ops = 0;
+
+  const u16 page = pc & 0xFF00;
+  while (num_ops < DYNAREC_MAX_OPS && (pc & 0xFF00) == page) {
+    const DecodedOp* decoded = this->decode(pc);
+    if (!decoded) break; // invalid opcode, or crosses into next page
+
+    const Instructions::Instr::Type instr =
+      Instructions::Opcodes[decoded->op].instr;
+    if (instr == Instructions::Instr::BRK) break;
+
+    // if (!burst_op(self, arg)) goto exit;
+    e.u8_(0x48); e.u8_(0x89); e.u8_(0xDF);     // mov rdi, rbx
+    e.u8_(0xBE); e.u32_(decoded->arg);         // mov esi, arg
+    e.u8_(0x48); e.u8_(0xB8);                  // mov rax, burst_op
+    e.u64_(u64(CPU::burst_op_handlers[decoded->op]));
+    e.u8_(0xFF); e.u8_(0xD0);                  // call rax
+    e.u8_(0x84); e.u8_(0xC0);                  // test al, al
+    e.u8_(0x0F); e.u8_(0x84); exits[num_ops] = e.len; e.u32_(0); // jz exit
+
+    num_ops++;
+    pc += decoded->len;
+
+    if (ends_block(instr)) break;
+  }
+
+  if (num_ops == 0) {
+    DecodedPage* p = this->code_page(pc);
+    p->heat[pc & 0xFF] = DYNAREC_NO_BLOCK;
+    return nullptr;
+  }
+
+  // exit:
+  for (uint i = 0; i < num_ops; i++) {
+    const u32 rel = e.len - (exits[i] + 4);
+    memcpy(e.code + exits[i], &rel, 4);
+  }
+  e.u8_(0x5B); // pop rbx
+  e.u8_(0xC3); // ret
+
+  this->dynarec.code_len += e.len;
+  this->dynarec_stats.compiled++;
+
+  return (DynBlock)(void*)e.code;
+#else
+  (void)pc;
+  fprintf(stderr, "[CPU] Dynarec is not supported on this platform! "
+                  "Falling back to interpreter.\n");
+  this->dynarec.unsupported = true;
+  return nullptr;
+#endif
+}
+
+void CPU::dynarec_free() {
+#ifdef DYNAREC_X64
+  if (this->dynarec.code)
+    munmap(this->dynarec.code, DYNAREC_CODE_SIZE);
+#endif
+  this->dynarec.code = nullptr;
+  this->dynarec.code_len = 0;
+}
+
+/*--------------------------------  Runtime  ---------------------------------*/
+
+CPU::DynBlock CPU::dynarec_block(u16 pc) {
+  if (this->dynarec.unsupported) return nullptr;
+
+  // PRG RAM can change under us, and isn't worth the hassle to validate
+  if (!this->mem.page_table().is_rom[pc >> 8]) return nullptr;
+
+  DecodedPage* page = this->code_page(pc);
+  const uint offset = pc & 0xFF;
+
+  DynBlock block = page->blocks[offset];
+  if (!block && page->heat[offset] != DYNAREC_NO_BLOCK) {
+    if (++page->heat[offset] == DYNAREC_HOT) {
+      // careful: might flush the decode cache (and `page` along with it)
+      block = this->dynarec_compile(pc);
+      if (block) page->blocks[offset] = block;
+    }
+  }
+
+  return block;
+}
@@ -0,0 +1,473 @@
+#include "cpu.h"
+#include "instructions.h"
+
+#include <cstdio>
+
+// Compile-time specialized opcode handlers.
+//
+// Instead of decoding the addressing mode and instruction at runtime (two
+// data-dependent switches per instruction), every one of the 256 opcodes gets
+// its own handler, stamped out from the `Instructions::Opcodes` table.
+//
+// The switches below look just like the ones in the classic interpreter, but
+// since they switch on template parameters, the compiler folds them away,
+// leaving only the code relevant to that particular opcode (i.e: no page-cross
+// check on a `zpg_` load, no dummy read on an `abs_` store, etc...)
+
+/*-----------------------  Addressing Mode Handlers  -------------------------*/
+
+// Fetches the raw operand bytes of an instruction (if any), advancing the PC.
+template <Instructions::AddrM::Type M>
+inline u16 CPU::fetch_operand() {
+  using namespace Instructions::AddrM;
+
+  #define arg8  (this->mem[this->reg.pc++])
+  #define arg16 (this->read16((this->reg.pc += 2) - 2))
+
+  #define dummy_read() this->mem.read(this->reg.pc)
+
+  u16 arg = 0x00;
+
+  switch(M) {
+    case abs_: case absX: case absY: case ind_:
+      arg = arg16; break;
+    case indY: case Xind: case zpg_: case zpgX: case zpgY:
+      arg = arg8; break;
+    case rel: case imm:
+      dummy_read(); this->reg.pc++; break;
+    case acc: case impl:
+      dummy_read(); break;
+    case INVALID: break;
+  }
+
+  #undef dummy_read
+  #undef arg16
+  #undef arg8
+
+  return arg;
+}
+
+// Resolves an instruction's operand address, given it's raw operand bytes.
+// Expects the PC to already point past the instruction.
+template <Instructions::AddrM::Type M, bool check_pg_cross>
+inline u16 CPU::resolve_addr(u16 arg) {
+  using namespace Instructions::AddrM;
+
+  u16 addr = 0xBAD; // this is what we are trying to find...
+
+  switch(M) {
+    case abs_: addr = arg;                                               break;
+    case absX: addr = arg + this->reg.x;                                 break;
+    case absY: addr = arg + this->reg.y;                                 break;
+    case ind_: addr = this->read16_zpg(arg);                             break;
+    case indY: addr = this->read16_zpg(arg) + this->reg.y;               break;
+    case Xind: addr = this->read16_zpg((arg + this->reg.x) & 0xFF);      break;
+    case zpg_: addr = arg;                                               break;
+    case zpgX: addr = (arg + this->reg.x) & 0xFF;                        break;
+    case zpgY: addr = (arg + this->reg.y) & 0xFF;                        break;
+    case rel : addr = this->reg.pc - 1;                                  break;
+    case imm : addr = this->reg.pc - 1;                                  break;
+    case acc : addr = this->reg.a;                                       break;
+    case impl: addr = u8(0xFACA11);                                      break;
+    case INVALID:
+      fprintf(stderr, "[CPU] Invalid Addressing Mode! Double check table!\n");
+      return 0xBAD;
+  }
+
+  // Only absX, absY, and indY are ever flagged with check_pg_cross
+  if (check_pg_cross) {
+    #define did_pg_cross(a,b) (((a) & 0xFF00) != ((b) & 0xFF00))
+    switch (M) {
+    case absX: this->cycles += did_pg_cross(addr - this->reg.x, addr); break;
+    case absY: this->cycles += did_pg_cross(addr - this->reg.y, addr); break;
+    case indY: this->cycles += did_pg_cross(addr - this->reg.y, addr); break;
+    default: break;
+    }
+    #undef did_pg_cross
+  }
+
+  return addr;
+}
+
+template <Instructions::AddrM::Type M, bool check_pg_cross>
+inline u16 CPU::operand_addr() {
+  u16 arg = this->fetch_operand<M>();
+  return this->resolve_addr<M, check_pg_cross>(arg);
+}
+
+/*------------------------  Instruction Handlers  ----------------------------*/
+
+template <Instructions::Instr::Type I, Instructions::AddrM::Type M>
+inline void CPU::instr(u16 addr) {
+  using namespace Instructions::Instr;
+
+  constexpr bool is_acc = M == Instructions::AddrM::acc;
+
+  // Set Zero and Negative flags
+  #define set_zn(val) \
+    this->reg.p.z = val == 0; \
+    this->reg.p.n = nth_bit(val, 7);
+
+  // Branch if condition is satisfied
+  #define branch(cond)                                                 \
+    if (!cond) break;                                                  \
+    i8 offset = i8(this->mem[addr]);                                   \
+    /* Extra cycle on succesful branch */                              \
+    this->cycles += 1;                                                 \
+    /* Check if extra cycles due to jumping across pages */            \
+    if ((this->reg.pc & 0xFF00) != ((this->reg.pc + offset) & 0xFF00)) \
+      this->cycles += 1;                                               \
+    this->reg.pc += offset;
+
+  switch (I) {
+      case ADC: { u8  val = this->mem[addr];
+                  u16 sum = this->reg.a + val + this->reg.p.c;
+                  this->reg.p.c = sum > 0xFF;
+                  this->reg.p.z = u8(sum) == 0;
+                  // http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
+                  this->reg.p.v = ~(this->reg.a ^ val)
+                                &  (this->reg.a ^ sum)
+                                & 0x80;
+                  this->reg.p.n = nth_bit(u8(sum), 7);
+                  this->reg.a = u8(sum);
+                } break;
+      case AND: { this->reg.a &= this->mem[addr];
+                  set_zn(this->reg.a);
+                } break;
+      case ASL: { if (is_acc) {
+                    this->reg.p.c = nth_bit(this->reg.a, 7);
+                    this->reg.a <<= 1;
+                    set_zn(this->reg.a);
+                  } else {
+                    u8 val = this->mem[addr];
+                    this->mem[addr] = val; // dummy-write
+                    this->reg.p.c = nth_bit(val, 7);
+                    val <<= 1;
+                    set_zn(val);
+                    this->mem[addr] = val;
+                  }
+                } break;
+      case BCC: { branch(!this->reg.p.c);
+                } break;
+      case BCS: { branch(this->reg.p.c);
+                } break;
+      case BEQ: { branch(this->reg.p.z);
+                } break;
+      case BIT: { u8 mem = this->mem[addr];
+                  this->reg.p.z = (this->reg.a & mem) == 0;
+                  this->reg.p.v = nth_bit(mem, 6);
+                  this->reg.p.n = nth_bit(mem, 7);
+                } break;
+      case BMI: { branch(this->reg.p.n);
+                } break;
+      case BNE: { branch(!this->reg.p.z);
+                } break;
+      case BPL: { branch(!this->reg.p.n);
+                } break;
+      case BRK: { // ignores interrupt disable bit, and forces an interrupt
+                  this->service_interrupt(Interrupts::IRQ, true);
+                } break;
+      case BVC: { branch(!this->reg.p.v);
+                } break;
+      case BVS: { branch(this->reg.p.v);
+                } break;
+      case CLC: { this->reg.p.c = 0;
+                } break;
+      case CLD: { this->reg.p.d = 0;
+                } break;
+      case CLI: { this->reg.p.i = 0;
+                } break;
+      case CLV: { this->reg.p.v = 0;
+                } break;
+      case CMP: { u8 val = this->mem[addr];
+                  this->reg.p.c = this->reg.a >= val;
+                  set_zn(this->reg.a - val);
+                } break;
+      case CPX: { u8 val = this->mem[addr];
+                  this->reg.p.c = this->reg.x >= val;
+                  set_zn(this->reg.x - val);
+                } break;
+      case CPY: { u8 val = this->mem[addr];
+                  this->reg.p.c = this->reg.y >= val;
+                  set_zn(this->reg.y - val);
+                } break;
+      case DEC: { u8 val = this->mem[addr];
+                  this->mem[addr] = val; // dummy-write
+                  val--;
+                  set_zn(val);
+                  this->mem[addr] = val;
+                } break;
+      case DEX: { this->reg.x--;
+                  set_zn(this->reg.x);
+                } break;
+      case DEY: { this->reg.y--;
+                  set_zn(this->reg.y);
+                } break;
+      case EOR: { this->reg.a ^= this->mem[addr];
+                  set_zn(this->reg.a);
+                } break;
+      case INC: { u8 val = this->mem[addr];
+                  this->mem[addr] = val; // dummy-write
+                  val++;
+                  set_zn(val);
+                  this->mem[addr] = val;
+                } break;
+      case INX: { this->reg.x++;
+                  set_zn(this->reg.x);
+                } break;
+      case INY: { this->reg.y++;
+                  set_zn(this->reg.y);
+                } break;
+      case JMP: { this->reg.pc = addr;
+                } break;
+      case JSR: { this->s_push16(this->reg.pc - 1);
+                  this->reg.pc = addr;
+                } break;
+      case LDA: { this->reg.a = this->mem[addr];
+                  set_zn(this->reg.a);
+                } break;
+      case LDX: { this->reg.x = this->mem[addr];
+                  set_zn(this->reg.x);
+                } break;
+      case LDY: { this->reg.y = this->mem[addr];
+                  set_zn(this->reg.y);
+                } break;
+      case LSR: { if (is_acc) {
+                    this->reg.p.c = nth_bit(this->reg.a, 0);
+                    this->reg.a >>= 1;
+                    set_zn(this->reg.a);
+                  } else {
+                    u8 val = this->mem[addr];
+                    this->mem[addr] = val; // dummy-write
+                    this->reg.p.c = nth_bit(val, 0);
+                    val >>= 1;
+                    set_zn(val);
+                    this->mem[addr] = val;
+                  }
+                } break;
+      case NOP: { // me_irl
+                } break;
+      case ORA: { this->reg.a |= this->mem[addr];
+                  set_zn(this->reg.a);
+                } break;
+      case PHA: { this->s_push(this->reg.a);
+                } break;
+      case PHP: { this->s_push(this->reg.p.raw | 0x30);
+                } break;
+      case PLA: { this->reg.a = this->s_pull();
+                  set_zn(this->reg.a);
+                } break;
+      case PLP: { this->reg.p.raw = this->s_pull() | 0x20; // NESTEST
+                } break;
+      case ROL: { if (is_acc) {
+                    bool old_bit_0 = nth_bit(this->reg.a, 7);
+                    this->reg.a = (this->reg.a << 1) | u8(this->reg.p.c);
+                    this->reg.p.c = old_bit_0;
+                    set_zn(this->reg.a);
+                  } else {
+                    u8 val = this->mem[addr];
+                    this->mem[addr] = val; // dummy-write
+                    bool old_bit_0 = nth_bit(val, 7);
+                    val = (val << 1) | u8(this->reg.p.c);
+                    this->reg.p.c = old_bit_0;
+                    set_zn(val);
+                    this->mem[addr] = val;
+                  }
+                } break;
+      case ROR: { if (is_acc) {
+                    bool old_bit_0 = nth_bit(this->reg.a, 0);
+                    this->reg.a = (this->reg.a >> 1) | (this->reg.p.c << 7);
+                    this->reg.p.c = old_bit_0;
+                    set_zn(this->reg.a);
+                  } else {
+                    u8 val = this->mem[addr];
+                    this->mem[addr] = val; // dummy-write
+                    bool old_bit_0 = nth_bit(val, 0);
+                    val = (val >> 1) | (this->reg.p.c << 7);
+                    this->reg.p.c = old_bit_0;
+                    set_zn(val);
+                    this->mem[addr] = val;
+                  }
+                } break;
+      case RTI: { this->reg.p.raw = this->s_pull() | 0x20; // NESTEST
+                  this->reg.pc = this->s_pull16();
+                } break;
+      case RTS: { this->reg.pc = this->s_pull16() + 1;
+                } break;
+      case SBC: { u8  val = this->mem[addr];
+                  u16 sum = this->reg.a + ~val + this->reg.p.c;
+                  this->reg.p.c = !(sum > 0xFF);
+                  this->reg.p.z = u8(sum) == 0;
+                  // http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
+                  this->reg.p.v = ~(this->reg.a ^ ~val)
+                                &  (this->reg.a ^ sum)
+                                & 0x80;
+                  this->reg.p.n = nth_bit(u8(sum), 7);
+                  this->reg.a = u8(sum);
+                } break;
+      case SEC: { this->reg.p.c = 1;
+                } break;
+      case SED: { this->reg.p.d = 1;
+                } break;
+      case SEI: { this->reg.p.i = 1;
+                } break;
+      case STA: { this->mem[addr] = this->reg.a;
+                } break;
+      case STX: { this->mem[addr] = this->reg.x;
+                } break;
+      case STY: { this->mem[addr] = this->reg.y;
+                } break;
+      case TAX: { this->reg.x = this->reg.a;
+                  set_zn(this->reg.x);
+                } break;
+      case TAY: { this->reg.y = this->reg.a;
+                  set_zn(this->reg.y);
+                } break;
+      case TSX: { this->reg.x = this->reg.s;
+                  set_zn(this->reg.x);
+                } break;
+      case TXA: { this->reg.a = this->reg.x;
+                  set_zn(this->reg.a);
+                } break;
+      case TXS: { this->reg.s = this->reg.x;
+                } break;
+      case TYA: { this->reg.a = this->reg.y;
+                  set_zn(this->reg.a);
+                } break;
+    default: break; // invalid opcodes are caught in CPU::exec
+  }
+
+  #undef branch
+  #undef set_zn
+}
+
+/*--------------------------  Opcode Handlers  -------------------------------*/
+
+template <u8 op>
+void CPU::exec() {
+  constexpr Instructions::Opcode opcode = Instructions::Opcodes[op];
+
+  u16 addr = this->operand_addr<opcode.addrm, opcode.check_pg_cross>();
+
+  if (opcode.instr == Instructions::Instr::INVALID) {
+    fprintf(stderr,
+      "[CPU] [%u] Unimplemented Instruction! 0x%02X\n",
+      this->cycles,
+      opcode.raw
+    );
+    this->is_running = false;
+    this->cycles += opcode.cycles; // (same as the switch-based interpreter)
+    return;
+  }
+
+  this->instr<opcode.instr, opcode.addrm>(addr);
+
+  this->cycles += opcode.cycles;
+}
+
+// Executes a pre-decoded instruction (see decode_cache.cc)
+// Expects the PC to already point past the instruction.
+template <u8 op>
+void CPU::exec_decoded(u16 arg) {
+  constexpr Instructions::Opcode opcode = Instructions::Opcodes[op];
+
+  u16 addr = this->resolve_addr<opcode.addrm, opcode.check_pg_cross>(arg);
+  this->instr<opcode.instr, opcode.addrm>(addr);
+
+  this->cycles += opcode.cycles;
+}
+
+// Checks that every data access an instruction is about to make would hit
+// plain memory (i.e: has no side-effects), without making any of them.
+template <Instructions::Instr::Type I, Instructions::AddrM::Type M>
+inline bool CPU::is_direct(u16 arg) const {
+  using namespace Instructions::Instr;
+  namespace AddrM = Instructions::AddrM;
+
+  constexpr bool is_rmw = (
+    I == ASL || I == LSR || I == ROL || I == ROR || I == INC || I == DEC
+  ) && M != AddrM::acc;
+  constexpr bool is_read = is_rmw || ((
+    I == ADC || I == AND || I == BIT || I == CMP || I == CPX || I == CPY ||
+    I == EOR || I == LDA || I == LDX || I == LDY || I == ORA || I == SBC
+  ) && M != AddrM::imm);
+  constexpr bool is_write = is_rmw || I == STA || I == STX || I == STY;
+
+  // JMP (ind) reads it's target from anywhere in memory
+  if (M == AddrM::ind_) return this->mem.is_direct_read(arg);
+
+  if (!is_read && !is_write) return true; // stack / operand accesses only
+
+  // Same as resolve_addr, except that it only peeks at the (zero page)
+  // pointers of indirect modes. Zero page is always WRAM.
+  u16 addr = arg;
+  switch (M) {
+    case AddrM::absX: addr = arg + this->reg.x;                            break;
+    case AddrM::absY: addr = arg + this->reg.y;                            break;
+    case AddrM::indY: addr = this->peek16_zpg(arg) + this->reg.y;          break;
+    case AddrM::Xind: addr = this->peek16_zpg((arg + this->reg.x) & 0xFF); break;
+    case AddrM::zpgX: addr = (arg + this->reg.x) & 0xFF;                   break;
+    case AddrM::zpgY: addr = (arg + this->reg.y) & 0xFF;                   break;
+    default: break;
+  }
+
+  return (!is_read  || this->mem.is_direct_read(addr))
+      && (!is_write || this->mem.is_direct_write(addr));
+}
+
+// Executes a pre-decoded instruction as part of a burst (see step_block), so
+// long as it doesn't have to touch any I/O.
+// Returns false when the burst should be ended, either before the instruction
+// (it needs the full interpreter), or after it (the cycle budget is used up).
+template <u8 op>
+bool CPU::burst_op(CPU* self, u16 arg) {
+  constexpr Instructions::Opcode opcode = Instructions::Opcodes[op];
+
+  if (!self->is_direct<opcode.instr, opcode.addrm>(arg))
+    return false;
+
+  self->reg.pc += Instructions::instr_len(opcode.addrm);
+  self->exec_decoded<op>(arg);
+
+  return self->cycles - self->burst.start < self->burst.budget;
+}
+
+// Generate the main handler table
+#define H(op) &CPU::exec<op>
+#define H16(hi) \
+  H(hi+0x0), H(hi+0x1), H(hi+0x2), H(hi+0x3), \
+  H(hi+0x4), H(hi+0x5), H(hi+0x6), H(hi+0x7), \
+  H(hi+0x8), H(hi+0x9), H(hi+0xA), H(hi+0xB), \
+  H(hi+0xC), H(hi+0xD), H(hi+0xE), H(hi+0xF)
+
+const CPU::OpHandler CPU::op_handlers[256] = {
+  H16(0x00), H16(0x10), H16(0x20), H16(0x30),
+  H16(0x40), H16(0x50), H16(0x60), H16(0x70),
+  H16(0x80), H16(0x90), H16(0xA0), H16(0xB0),
+  H16(0xC0), H16(0xD0), H16(0xE0), H16(0xF0),
+};
+
+#undef H
+
+#define H(op) &CPU::exec_decoded<op>
+
+const CPU::DecodedOpHandler CPU::decoded_op_handlers[256] = {
+  H16(0x00), H16(0x10), H16(0x20), H16(0x30),
+  H16(0x40), H16(0x50), H16(0x60), H16(0x70),
+  H16(0x80), H16(0x90), H16(0xA0), H16(0xB0),
+  H16(0xC0), H16(0xD0), H16(0xE0), H16(0xF0),
+};
+
+#undef H
+
+#define H(op) &CPU::burst_op<op>
+
+const CPU::BurstOpHandler CPU::burst_op_handlers[256] = {
+  H16(0x00), H16(0x10), H16(0x20), H16(0x30),
+  H16(0x40), H16(0x50), H16(0x60), H16(0x70),
+  H16(0x80), H16(0x90), H16(0xA0), H16(0xB0),
+  H16(0xC0), H16(0xD0), H16(0xE0), H16(0xF0),
+};
+
+#undef H16
+#undef H
@@ -0,0 +1,166 @@
+#include "cpu.h"
+#include "instructions.h"
+
+#include <cstring>
+
+// Idle Loop Skipping
+//
+// Lots of games spend most of each frame spinning in a tight loop, waiting for
+// the NMI handler to set a flag in RAM, or for the vblank flag in PPUSTATUS to
+// get set (e.g: `wait: LDA $2002 / BPL wait`).
+//
+// Whenever the CPU jumps backwards a short distance, the next iteration of the
+// loop gets recorded: the register state before each op, the value each op
+// read, and the cycles each op took. If the registers end up exactly where
+// they started, and the loop only reads memory (without side-effects), the
+// loop has settled into a fixed point, and every subsequent iteration will be
+// identical... until one of the values it reads changes.
+//
+// From then on, the loop is replayed from the recording instead of being
+// executed. Each replayed op just loads the recorded registers, and returns
+// the recorded cycles, so the rest of the NES is stepped just as it would be
+// otherwise. Replaying stops as soon as anything could make an op behave
+// differently than it did in the recording:
+// - An interrupt is pending (checked by CPU::step, as usual)
+// - A value that an op reads has changed (e.g: vblank started)
+// - The registers don't match the recording (e.g: a savestate got loaded)
+
+// Does an instruction only touch registers (and maybe read memory)?
+static bool is_idle_op(const Instructions::Opcode& opcode) {
+  using namespace Instructions::Instr;
+  namespace AddrM = Instructions::AddrM;
+
+  switch (opcode.instr) {
+  // reads
+  case ADC: case AND: case BIT: case CMP: case CPX: case CPY:
+  case EOR: case LDA: case LDX: case LDY: case ORA: case SBC:
+    return opcode.addrm == AddrM::imm
+        || opcode.addrm == AddrM::zpg_
+        || opcode.addrm == AddrM::abs_;
+  // register-only
+  case ASL: case LSR: case ROL: case ROR:
+    return opcode.addrm == AddrM::acc;
+  case CLC: case CLD: case CLI: case CLV: case SEC: case SED: case SEI:
+  case DEX: case DEY: case INX: case INY: case NOP:
+  case TAX: case TAY: case TSX: case TXA: case TXS: case TYA:
+    return true;
+  // control flow
+  case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC:
+  case BVS:
+    return true;
+  case JMP:
+    return opcode.addrm == AddrM::abs_;
+  default:
+    return false;
+  }
+}
+
+static bool is_ppustatus(u16 addr) { return (addr & 0xE007) == 0x2002; }
+
+template <typename Registers>
+static bool same_regs(const Registers& a, const Registers& b) {
+  return a.pc == b.pc && a.s == b.s && a.p.raw == b.p.raw
+      && a.a  == b.a  && a.x == b.x && a.y     == b.y;
+}
+
+void CPU::idle_loop_detect(u16 old_pc) {
+  const u16 head = this->reg.pc;
+  if (uint(old_pc - head) > IDLE_LOOP_MAX_BYTES) return;
+  if (head == this->idle_loop.rejected) return;
+
+  this->idle_loop.state = this->idle_loop.RECORDING;
+  this->idle_loop.head = head;
+  this->idle_loop.len = 0;
+  this->idle_loop.retries = 0;
+}
+
+bool CPU::idle_loop_record_start() {
+  const u16 pc = this->reg.pc;
+
+  const Instructions::Opcode& opcode = Instructions::Opcodes[this->mem.peek(pc)];
+  const uint len = Instructions::instr_len(opcode.addrm);
+
+  // Instruction (and dummy) fetches have to be side-effect free too
+  const bool can_fetch = this->mem.is_direct_read(pc)
+    && this->mem.is_direct_read(pc + (len < 2 ? 2 : len) - 1);
+
+  if (!can_fetch || !is_idle_op(opcode)) {
+    this->idle_loop.state = this->idle_loop.NONE;
+    return false;
+  }
+
+  IdleLoopOp& op = this->idle_loop.ops[this->idle_loop.len];
+  memcpy(&op.regs, &this->reg, sizeof op.regs);
+  op.reads = opcode.instr != Instructions::Instr::JMP && (
+    opcode.addrm == Instructions::AddrM::zpg_ ||
+    opcode.addrm == Instructions::AddrM::abs_
+  );
+
+  if (op.reads) {
+    op.addr = len == 3 ? this->peek16(pc + 1) : this->mem.peek(pc + 1);
+    op.val  = this->mem.peek(op.addr);
+
+    // Reading PPUSTATUS clears the vblank flag, which is only idempotent if
+    // it's already cleared. The other side-effects (clearing the scroll latch,
+    // filling the data bus) are always idempotent.
+    const bool can_read = is_ppustatus(op.addr)
+      ? !nth_bit(op.val, 7)
+      : this->mem.is_direct_read(op.addr);
+
+    if (!can_read) {
+      this->idle_loop.state = this->idle_loop.NONE;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void CPU::idle_loop_record_end(uint cycles) {
+  this->idle_loop.ops[this->idle_loop.len++].cycles = cycles;
+
+  if (this->reg.pc == this->idle_loop.head) {
+    if (same_regs(this->reg, this->idle_loop.ops[0].regs)) {
+      // Made it back where we started, so the loop is idle!
+      this->idle_loop.state = this->idle_loop.SKIPPING;
+      this->idle_loop.pos = 0;
+      this->idle_loop_stats.loops++;
+      return;
+    }
+
+    // The first iteration might've been entered with some unrelated register
+    // state (e.g: jumping back to the start of a main loop), so give it one
+    // more shot to settle
+    if (this->idle_loop.retries++ == 0) {
+      this->idle_loop.len = 0;
+      return;
+    }
+  } else if (this->idle_loop.len < IDLE_LOOP_MAX_OPS) {
+    return; // keep recording
+  }
+
+  // Not an idle loop (e.g: a delay loop counting down a register)
+  this->idle_loop.state = this->idle_loop.NONE;
+  this->idle_loop.rejected = this->idle_loop.head;
+}
+
+bool CPU::idle_loop_skip() {
+  const IdleLoopOp& op = this->idle_loop.ops[this->idle_loop.pos];
+
+  const bool changed = !same_regs(this->reg, op.regs)
+    || (op.reads && this->mem.peek(op.addr) != op.val);
+
+  if (changed) {
+    this->idle_loop.state = this->idle_loop.NONE;
+    return false;
+  }
+
+  this->idle_loop.pos = (this->idle_loop.pos + 1) % this->idle_loop.len;
+  memcpy(&this->reg, &this->idle_loop.ops[this->idle_loop.pos].regs,
+    sizeof this->reg);
+
+  this->cycles += op.cycles;
+  this->idle_loop_stats.cycles += op.cycles;
+
+  return true;
+}
@@ -42,6 +42,17 @@ struct Opcode {
   const char* addrm_type; // Addressing Mode Name
 };
 
+// Instruction length (in bytes) for a given addressing mode
+constexpr inline uint instr_len(AddrM::Type addrm) {
+  return (addrm == AddrM::abs_ || addrm == AddrM::absX ||
+          addrm == AddrM::absY || addrm == AddrM::ind_) ? 3
+       : (addrm == AddrM::indY || addrm == AddrM::Xind ||
+          addrm == AddrM::zpg_ || addrm == AddrM::zpgX ||
+          addrm == AddrM::zpgY || addrm == AddrM::rel  ||
+          addrm == AddrM::imm) ? 2
+       : 1;
+}
+
 // This macro magic makes the Opcode definition list look a lot nicer comapred
 // to the raw alternative.
 // Just compare a raw definition to a corresponding macro'd definition:
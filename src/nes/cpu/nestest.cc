@@ -1,13 +1,15 @@
-#include "cpu.h"
+#include "trace.h"
 #include "instructions.h"
 
 #include <cstdio>
 
-void CPU::nestest(const CPU& cpu, const Instructions::Opcode& opcode) {
+void CPUTrace::format(const CPUTrace::Record& r, char* buf) {
   using namespace Instructions;
 
+  const Opcode& opcode = Opcodes[r.op];
+
   // Print PC and raw opcode byte
-  printf("%04X  %02X ", cpu.reg.pc - 1, opcode.raw);
+  buf += sprintf(buf, "%04X  %02X ", r.pc, opcode.raw);
 
   // create buffer for instruction operands
   char instr_buf [64];
@@ -18,8 +20,8 @@ void CPU::nestest(const CPU& cpu, const Instructions::Opcode& opcode) {
   using namespace Instructions::AddrM;
 
   // Evaluate a few useful values
-  u8  arg8   = cpu.mem.peek(cpu.reg.pc + 0);
-  u8  arg8_2 = cpu.mem.peek(cpu.reg.pc + 1);
+  u8  arg8   = r.arg[0];
+  u8  arg8_2 = r.arg[1];
   u16 arg16  = arg8 | (arg8_2 << 8);
 
   // Print operand bytes
@@ -29,7 +31,7 @@ void CPU::nestest(const CPU& cpu, const Instructions::Opcode& opcode) {
     case absX:
     case absY:
     case ind_:
-      printf("%02X %02X", arg8, arg8_2);
+      buf += sprintf(buf, "%02X %02X", arg8, arg8_2);
       break;
     case indY:
     case Xind:
@@ -38,81 +40,58 @@ void CPU::nestest(const CPU& cpu, const Instructions::Opcode& opcode) {
     case zpgY:
     case rel :
     case imm :
-      printf("%02X   "  , arg8);
+      buf += sprintf(buf, "%02X   "  , arg8);
       break;
     default:
-      printf("     ");
+      buf += sprintf(buf, "     ");
       break;
   }
 
   // Print Instruction Name
-  printf("  %s ", iname);
+  buf += sprintf(buf, "  %s ", iname);
 
   // Decode addressing mode
   switch(opcode.addrm) {
     case abs_: addr = arg16;                                              break;
-    case absX: addr = arg16 + cpu.reg.x;                                  break;
-    case absY: addr = arg16 + cpu.reg.y;                                  break;
-    case ind_: addr = cpu.peek16_zpg(arg16);                              break;
-    case indY: addr = cpu.peek16_zpg(arg8) + cpu.reg.y;                   break;
-    case Xind: addr = cpu.peek16_zpg((arg8 + cpu.reg.x) & 0xFF);          break;
+    case absX: addr = arg16 + r.x;                                        break;
+    case absY: addr = arg16 + r.y;                                        break;
+    case ind_: addr = r.ptr;                                              break;
+    case indY: addr = r.ptr + r.y;                                        break;
+    case Xind: addr = r.ptr;                                              break;
     case zpg_: addr = arg8;                                               break;
-    case zpgX: addr = (arg8 + cpu.reg.x) & 0xFF;                          break;
-    case zpgY: addr = (arg8 + cpu.reg.y) & 0xFF;                          break;
-    case rel : addr = cpu.reg.pc;                                         break;
-    case imm : addr = cpu.reg.pc;                                         break;
-    case acc : addr = cpu.reg.a;                                          break;
+    case zpgX: addr = (arg8 + r.x) & 0xFF;                                break;
+    case zpgY: addr = (arg8 + r.y) & 0xFF;                                break;
+    case rel : addr = r.pc + 1;                                           break;
+    case imm : addr = r.pc + 1;                                           break;
+    case acc : addr = r.a;                                                break;
     case impl: addr = u8(0xFACA11);                                       break;
     default: break;
   }
 
   // Print specific instrucion operands for each addressing mode
   switch(opcode.addrm) {
-  case abs_: sprintf(instr_buf, "$%04X = %02X",
-                           arg16,
-              cpu.mem.peek(arg16)
-            ); break;
+  case abs_: sprintf(instr_buf, "$%04X = %02X", arg16, r.val);            break;
   case absX: sprintf(instr_buf, "$%04X,X @ %04X = %02X",
-                           arg16,
-                       u16(arg16 + cpu.reg.x),
-              cpu.mem.peek(arg16 + cpu.reg.x)
+              arg16, addr, r.val
             ); break;
   case absY: sprintf(instr_buf, "$%04X,Y @ %04X = %02X",
-                           arg16,
-                       u16(arg16 + cpu.reg.y),
-              cpu.mem.peek(arg16 + cpu.reg.y)
+              arg16, addr, r.val
             ); break;
   case indY: sprintf(instr_buf, "($%02X),Y = %04X @ %04X = %02X",
-                                          arg8,
-                           cpu.peek16_zpg(arg8),
-                       u16(cpu.peek16_zpg(arg8) + cpu.reg.y),
-              cpu.mem.peek(cpu.peek16_zpg(arg8) + cpu.reg.y)
+              arg8, r.ptr, addr, r.val
             ); break;
   case Xind: sprintf(instr_buf, "($%02X,X) @ %02X = %04X = %02X",
-                                                         arg8,
-                                          u8(cpu.reg.x + arg8),
-                           cpu.peek16_zpg(u8(cpu.reg.x + arg8)),
-              cpu.mem.peek(cpu.peek16_zpg(u8(cpu.reg.x + arg8)))
-            ); break;
-  case ind_: sprintf(instr_buf, "($%04X) = %04X",
-                             arg16,
-              cpu.peek16_zpg(arg16)
-            ); break;
-  case zpg_: sprintf(instr_buf, "$%02X = %02X",
-                           arg8,
-              cpu.mem.peek(arg8)
+              arg8, u8(r.x + arg8), r.ptr, r.val
             ); break;
+  case ind_: sprintf(instr_buf, "($%04X) = %04X", arg16, r.ptr);          break;
+  case zpg_: sprintf(instr_buf, "$%02X = %02X", arg8, r.val);             break;
   case zpgX: sprintf(instr_buf, "$%02X,X @ %02X = %02X",
-                              arg8,
-                           u8(arg8 + cpu.reg.x),
-              cpu.mem.peek(u8(arg8 + cpu.reg.x))
+              arg8, addr, r.val
             ); break;
   case zpgY: sprintf(instr_buf, "$%02X,Y @ %02X = %02X",
-                              arg8,
-                           u8(arg8 + cpu.reg.y),
-              cpu.mem.peek(u8(arg8 + cpu.reg.y))
+              arg8, addr, r.val
             ); break;
-  case rel : sprintf(instr_buf, "$%04X", cpu.reg.pc + 1 + i8(arg8));      break;
+  case rel : sprintf(instr_buf, "$%04X", r.pc + 2 + i8(arg8));            break;
   case imm : sprintf(instr_buf, "#$%02X", arg8);                          break;
   case acc : sprintf(instr_buf, " ");                                     break;
   case impl: sprintf(instr_buf, " ");                                     break;
@@ -139,18 +118,15 @@ void CPU::nestest(const CPU& cpu, const Instructions::Opcode& opcode) {
   }
 
   // Print instruction operands
-  printf("%-28s", instr_buf);
+  buf += sprintf(buf, "%-28s", instr_buf);
 
   // Print processor state
-  printf("A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%3u\n",
-    cpu.reg.a,
-    cpu.reg.x,
-    cpu.reg.y,
-    cpu.reg.p.raw & ~0x10, // 0b11101111, match nestest "golden" log
-    cpu.reg.s,
-    (cpu.cycles - 7) * 3 % 341 // CYC measures PPU X coordinates
-                         // PPU does 1 x coordinate per cycle
-                         // PPU runs 3x as fast as CPU
-                         // ergo, multiply cycles by 3 should be fineee
+  sprintf(buf, "A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%3u",
+    r.a,
+    r.x,
+    r.y,
+    r.p & ~0x10, // 0b11101111, match nestest "golden" log
+    r.s,
+    r.dot // CYC measures PPU X coordinates
   );
 }
@@ -0,0 +1,80 @@
+#include "trace.h"
+#include "cpu.h"
+#include "instructions.h"
+
+#include "nes/ppu/ppu.h"
+
+CPUTrace::CPUTrace(const PPU& ppu) : ppu(ppu) {}
+CPUTrace::~CPUTrace() { delete[] this->ring; }
+
+CPUTrace::Record& CPUTrace::push() {
+  if (!this->ring) this->ring = new Record [SIZE];
+
+  Record& r = this->ring[this->head];
+  this->head = (this->head + 1) % SIZE;
+  if (this->len < SIZE) this->len++;
+
+  r.scanline = this->ppu._scanline();
+  r.dot      = this->ppu._scancycle();
+
+  return r;
+}
+
+// Only peeks at memory, so recording a trace never changes emulation
+const CPUTrace::Record& CPU::trace_instr() {
+  using namespace Instructions::AddrM;
+
+  CPUTrace::Record& r = this->trace.push();
+
+  const u16 pc = this->reg.pc;
+  const Instructions::Opcode& opcode = Instructions::Opcodes[this->mem.peek(pc)];
+
+  r.cycles = this->cycles;
+  r.pc     = pc;
+  r.op     = opcode.raw;
+  r.arg[0] = this->mem.peek(pc + 1);
+  r.arg[1] = this->mem.peek(pc + 2);
+  r.a      = this->reg.a;
+  r.x      = this->reg.x;
+  r.y      = this->reg.y;
+  r.p      = this->reg.p.raw;
+  r.s      = this->reg.s;
+  r.ptr    = 0x0000;
+  r.val    = 0x00;
+
+#ifdef NESTEST
+  // The golden log starts counting PPU X coordinates from the first
+  // instruction, assuming 3 PPU cycles per CPU cycle
+  r.dot = (this->cycles - 7) * 3 % 341;
+#endif
+
+  const u8  arg8  = r.arg[0];
+  const u16 arg16 = r.arg[0] | (r.arg[1] << 8);
+
+  u16 addr;
+  switch (opcode.addrm) {
+  case abs_: addr = arg16;                                    break;
+  case absX: addr = arg16 + this->reg.x;                      break;
+  case absY: addr = arg16 + this->reg.y;                      break;
+  case indY: r.ptr = this->peek16_zpg(arg8);
+             addr = r.ptr + this->reg.y;                      break;
+  case Xind: r.ptr = this->peek16_zpg(u8(arg8 + this->reg.x));
+             addr = r.ptr;                                    break;
+  case zpg_: addr = arg8;                                     break;
+  case zpgX: addr = u8(arg8 + this->reg.x);                   break;
+  case zpgY: addr = u8(arg8 + this->reg.y);                   break;
+  case ind_: r.ptr = this->peek16_zpg(arg16);                 return r;
+  default:                                                    return r;
+  }
+
+  // Stores don't care what was there before, and peeking at write-only I/O
+  // registers isn't meaningful (and gets the APU complaining)
+  const bool is_store = opcode.instr == Instructions::Instr::STA
+                     || opcode.instr == Instructions::Instr::STX
+                     || opcode.instr == Instructions::Instr::STY;
+  if (is_store && !this->mem.is_direct_read(addr)) return r;
+
+  r.val = this->mem.peek(addr);
+
+  return r;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common/util.h"
+
+class PPU;
+
+// CPU Trace
+// A fixed-size ring buffer of compact binary records, one per executed
+// instruction, holding everything needed to render a nestest-style log line
+// after the fact (see CPUTrace::format).
+//
+// Recording a trace is just a handful of loads / stores per instruction, so
+// unlike printing a line of text per instruction, it's cheap enough to leave
+// on while actually playing games. The ring can be dumped to disk at any time
+// (e.g: right after something goes wrong), and decoded offline.
+class CPUTrace final {
+public:
+  struct Record {
+    u32 cycles;   // CPU cycle count before executing the instruction
+    u16 pc;
+    u16 ptr;      // pointer read by indirect addressing modes
+    u16 scanline; // PPU position before executing the instruction
+    u16 dot;
+    u8  op;
+    u8  arg [2];  // operand bytes
+    u8  a, x, y, p, s;
+    u8  val;      // value at the effective address (memory addressing modes)
+  };
+
+  static constexpr uint SIZE = 0x10000; // records (~1.5 MB)
+
+  // Renders a record as a (nul terminated) line of nestest-style text
+  // (exactly as in the nestest "golden" log, so no scanline column)
+  // `buf` must be at least FORMAT_LEN bytes long.
+  // (implemented in nestest.cc)
+  static constexpr uint FORMAT_LEN = 128;
+  static void format(const Record& record, char* buf);
+
+private:
+  const PPU& ppu;
+
+  Record* ring = nullptr; // allocated on first use
+  uint    head = 0;       // index of the next record to be written
+  uint    len  = 0;       // number of valid records
+
+public:
+  ~CPUTrace();
+  CPUTrace(const PPU& ppu);
+
+  // Returns a fresh record to fill in, overwriting the oldest one if the ring
+  // is full. Only the PPU position is filled in.
+  Record& push();
+
+  void clear() { this->head = this->len = 0; }
+
+  uint size() const { return this->len; }
+  // 0 is the oldest record, size() - 1 is the newest one
+  const Record& operator[](uint i) const {
+    return this->ring[(this->head + SIZE - this->len + i) % SIZE];
+  }
+};
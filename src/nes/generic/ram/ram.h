@@ -31,4 +31,7 @@ public:
   // </Memory>
 
   void clear();
+
+  // Direct access to underlying memory (for page-table mapping)
+  u8* data() { return this->ram; }
 };
@@ -12,7 +12,7 @@ ppu_pram(32, "Palette"),
 // Processors
 // (techincally UB since we pass references to objects that have not been
 // initialized yet...)
-cpu(params, this->cpu_mmu, this->interrupts),
+cpu(params, this->cpu_mmu, this->interrupts, this->cpu_trace),
 apu(params, this->cpu_mmu, this->interrupts),
 ppu(params,
   this->ppu_mmu,
@@ -33,8 +33,18 @@ ppu_mmu(
 joy(),
 dma(this->cpu_mmu),
 interrupts(),
-params(params)
-{}
+cpu_trace(this->ppu),
+params(params),
+overclock_stats()
+{
+  this->ppu._callbacks.scanline.add_cb(NES::cb_ppu_scanline, this);
+}
+
+void NES::cb_ppu_scanline(void* self) {
+  NES* nes = (NES*)self;
+  if (nes->cart_timing & Mapper::Timing::SCANLINE)
+    nes->cart->scanline();
+}
 
 void NES::updated_params() {
   this->apu.set_speed(this->params.speed / 100.0);
@@ -46,6 +56,14 @@ bool NES::loadCartridge(Mapper* cart) {
 
   this->cart = cart;
   this->cart->set_interrupt_line(&this->interrupts);
+  this->cart->set_ppu(&this->ppu);
+  this->cart_timing = cart->timing();
+
+  this->cpu.flush_decode_cache();
+  this->cpu.resetIdleLoopStats();
+  this->ppu.resetSyncStats();
+  this->overclock_stats = OverclockStats();
+  this->cpu_trace.clear();
 
   this->cpu_mmu.loadCartridge(this->cart);
   this->ppu_mmu.loadCartridge(this->cart);
@@ -56,9 +74,36 @@ bool NES::loadCartridge(Mapper* cart) {
 }
 
 void NES::removeCartridge() {
-  if (this->cart)
+  if (this->cart && this->params.cpu_idle_loops) {
+    const CPU::IdleLoopStats& stats = this->cpu.getIdleLoopStats();
+    fprintf(stderr, "[NES] Idle loops: found %llu, skipped %llu CPU cycles\n",
+      (unsigned long long)stats.loops,
+      (unsigned long long)stats.cycles
+    );
+  }
+
+  if (this->cart && this->params.ppu_extra_lines) {
+    const OverclockStats& stats = this->overclock_stats;
+    const double lines = this->params.ppu_extra_lines;
+    fprintf(stderr, "[NES] Overclock: %.0f extra lines per frame, %.1f used "
+                    "on average, %.1f at most, %llu / %llu frames used them "
+                    "all\n",
+      lines,
+      stats.cycles ? lines * stats.used / stats.cycles : 0.0,
+      stats.peak * 3 / 341.0,
+      (unsigned long long)stats.full_frames,
+      (unsigned long long)stats.frames
+    );
+  }
+
+  if (this->cart) {
     this->cart->set_interrupt_line(nullptr);
+    this->cart->set_ppu(nullptr);
+  }
   this->cart = nullptr;
+  this->cart_timing = 0;
+
+  this->cpu.flush_decode_cache();
 
   this->cpu_mmu.removeCartridge();
   this->ppu_mmu.removeCartridge();
@@ -89,6 +134,7 @@ void NES::power_cycle() {
   this->apu.power_cycle();
   this->cpu.power_cycle();
   this->ppu.power_cycle();
+  this->ppu_mmu.power_cycle();
 
   if (this->cart)
     this->cart->power_cycle();
@@ -118,26 +164,97 @@ void NES::reset() {
 void NES::cycle() {
   if (this->is_running == false) return;
 
-  // Execute a CPU instruction
-  uint cpu_cycles = this->cpu.step();
+  // While the PPU is in its extra (overclocked) lines, the PPU and APU are
+  // held, so the extra time is invisible to them. The CPU (and anything on the
+  // CPU bus, like MMC1's write debouncing) keeps running.
+  const uint overclock = (this->ppu.overclock_left() + 2) / 3;
+  const u64 idle_cycles = this->cpu.getIdleLoopStats().cycles;
+
+  // Let the CPU run ahead until the next scheduled event (or I/O access)
+  uint cpu_cycles = this->cpu.step_block(this->cycles_until_event());
+
+  // CPU cycles run during extra lines (which always end on an event, give or
+  // take the last instruction)
+  const uint held = cpu_cycles < overclock ? cpu_cycles : overclock;
+  if (held) {
+    uint idle = this->cpu.getIdleLoopStats().cycles - idle_cycles;
+    if (idle > held) idle = held;
+    this->overclock_tally(held, idle, held == overclock);
+  }
 
   // Run APU 1x per cpu_cycle
-  for (uint i = 0; i < cpu_cycles; i++)
-    this->apu.cycle();
+  // The APU is only caught up once the CPU could notice (see APU::run)
+  this->apu.run(cpu_cycles - held);
 
   if (this->apu.stall_cpu())
     cpu_cycles += 4; // not entirely accurate... depends on other factors
 
-  // Run PPU + Cartridge 3x per cpu_cycle
-  for (uint i = 0; i < cpu_cycles * 3; i++) {
-    this->ppu.cycle();
-    this->cart->cycle();
-  }
+  // Run PPU 3x per cpu_cycle
+  // The PPU is only caught up once the CPU could notice (see PPU::run), except
+  // when PPU fetches could clock a mapper IRQ, or the CPU trace needs its
+  // position.
+  this->ppu.run(cpu_cycles * 3);
+  if (this->params.log_cpu || this->cart->cycles_until_irq() <= this->ppu.getLag())
+    this->ppu.sync();
+
+  // PPU A12 edges / scanlines reach the cart through the PPU (see PPU_MMU)
+  if (this->cart_timing & Mapper::Timing::CPU_CYCLE)
+    for (uint i = 0; i < cpu_cycles; i++)
+      this->cart->cpu_cycle();
 
   if (!this->cpu.isRunning())
     this->is_running = false;
 }
 
+// The "scheduler": every component reports how long it'll be until its next
+// event that the CPU could observe without touching I/O (PPU vblank / NMI and
+// frame ends, APU frame IRQs and DMC fetches, mapper IRQs), and the CPU gets to
+// run freely until the earliest one.
+uint NES::cycles_until_event() const {
+  uint ppu_cycles = this->ppu.cycles_until_event();
+
+  // Nothing but the CPU runs during extra lines (see NES::cycle), so the only
+  // thing to wait for is the end of them
+  if (this->ppu.overclock_left())
+    return (ppu_cycles + 2) / 3;
+
+  // Mapper IRQs are counted from where the PPU is, not from where the CPU is.
+  // The PPU always catches up before it gets that far behind (see NES::cycle)
+  uint cart_cycles = this->cart->cycles_until_irq();
+  if (cart_cycles != UINT_MAX)
+    cart_cycles = cart_cycles > this->ppu.getLag()
+      ? cart_cycles - this->ppu.getLag()
+      : 0;
+  if (cart_cycles < ppu_cycles) ppu_cycles = cart_cycles;
+
+  // PPU + Cartridge run 3x per cpu_cycle
+  uint cycles = (ppu_cycles + 2) / 3;
+
+  uint apu_cycles = this->apu.cycles_until_event();
+  if (apu_cycles < cycles) cycles = apu_cycles;
+
+  return cycles;
+}
+
+void NES::overclock_tally(uint cycles, uint idle, bool frame_done) {
+  OverclockStats& stats = this->overclock_stats;
+
+  stats.cycles       += cycles;
+  stats.used         += cycles - idle;
+  stats.frame_cycles += cycles;
+  stats.frame_used   += cycles - idle;
+
+  if (!frame_done) return;
+
+  stats.frames++;
+  if (stats.frame_used == stats.frame_cycles) stats.full_frames++;
+  if (stats.frame_used > stats.peak) stats.peak = stats.frame_used;
+  stats.last = stats.frame_used;
+
+  stats.frame_cycles = 0;
+  stats.frame_used   = 0;
+}
+
 void NES::step_frame() {
   if (this->is_running == false) return;
 
@@ -151,6 +268,18 @@ void NES::getFramebuff(const u8** framebuffer) const {
   this->ppu.getFramebuff(framebuffer);
 }
 
+void NES::copyFramebuff(u8* argb, uint pitch) const {
+  this->ppu.copyFramebuff(argb, pitch);
+}
+
+void NES::skipRender(bool skip) {
+  this->ppu.skipRender(skip);
+}
+
 void NES::getAudiobuff(float** samples, uint* len) {
   this->apu.getAudiobuff(samples, len);
 }
+
+void NES::adjustAudioRate(float ratio) {
+  this->apu.set_rate_adjust(ratio);
+}
@@ -6,6 +6,7 @@
 #include "apu/apu.h"
 #include "cartridge/mapper.h"
 #include "cpu/cpu.h"
+#include "cpu/trace.h"
 #include "generic/ram/ram.h"
 #include "joy/joy.h"
 #include "ppu/dma.h"
@@ -30,6 +31,7 @@ private:
   // I.e: Things not present on the NES mainboard
 
   Mapper* cart = nullptr; // Game Cartridge
+  uint cart_timing = 0;   // Timing hooks the cart needs (see Mapper::Timing)
 
   /*----------  Chips  ----------*/
   RAM cpu_wram; // 2k CPU general purpose Work RAM
@@ -55,6 +57,9 @@ private:
   // Interrupt wiring
   InterruptLines interrupts;
 
+  // Executed instruction trace (recorded while params.log_cpu is set)
+  CPUTrace cpu_trace;
+
   /*=====================================
   =            Emulator Vars            =
   =====================================*/
@@ -87,6 +92,34 @@ public:
   }
 private:
   const NES_Params& params;
+
+  // CPU cycles until the next interrupt / DMC stall / frame end could happen
+  uint cycles_until_event() const;
+
+  // Forwards PPU scanlines to carts with Mapper::Timing::SCANLINE
+  static void cb_ppu_scanline(void* self);
+
+public:
+  // How much of the extra CPU time from overclocking games actually use (see
+  // NES_Params::ppu_extra_lines).
+  // Time spent in idle loops counts as unused, so this relies on
+  // NES_Params::cpu_idle_loops to tell when a game is done with its frame.
+  struct OverclockStats {
+    u64 frames;      // frames with extra lines
+    u64 cycles;      // CPU cycles run during extra lines
+    u64 used;        // ...which weren't spent idling
+    u64 full_frames; // frames that used up all their extra lines
+    uint peak;       // most CPU cycles used in a single frame
+    uint last;       // CPU cycles used in the last frame
+
+    uint frame_cycles; // (in the current frame)
+    uint frame_used;
+  };
+
+private:
+  OverclockStats overclock_stats;
+  void overclock_tally(uint cycles, uint idle, bool frame_done);
+
 public:
   NES(const NES_Params& new_params);
   void updated_params();
@@ -106,7 +139,10 @@ public:
   void step_frame(); // Cycle the NES until there is a new frame to display
 
   void getFramebuff(const u8** framebuffer) const;
+  void copyFramebuff(u8* argb, uint pitch) const; // see PPU::copyFramebuff
+  void skipRender(bool skip); // don't draw frames (e.g: when fast-forwarding)
   void getAudiobuff(float** samples, uint* len);
+  void adjustAudioRate(float ratio); // see APU::set_rate_adjust
 
   bool isRunning() const { return this->is_running; }
 
@@ -116,6 +152,12 @@ public:
   CPU& _cpu() { return this->cpu; }
   PPU& _ppu() { return this->ppu; }
 
+  const CPUTrace& _cpu_trace() const { return this->cpu_trace; }
+
+  const OverclockStats& getOverclockStats() const {
+    return this->overclock_stats;
+  }
+
   struct {
     CallbackManager<Mapper*> cart_changed;
     CallbackManager<> savestate_created;
@@ -4,7 +4,12 @@
 
 struct NES_Params {
   uint apu_sample_rate; // in Hz
+  uint apu_oversample;  // synthesize audio at N x the sample rate (see apu/filters.h)
   uint speed;           // in %
   bool log_cpu;
   bool ppu_timing_hack;
+  uint ppu_extra_lines;  // overclocking, in extra idle lines per frame (see ppu.h)
+  bool cpu_decode_cache; // cache decoded instructions (see cpu/decode_cache.cc)
+  bool cpu_dynarec;      // run hot PRG ROM code natively (see cpu/dynarec.cc)
+  bool cpu_idle_loops;   // replay idle loops (see cpu/idle_loop.cc)
 };
@@ -0,0 +1,123 @@
+#include "argb.h"
+
+#include <cstring>
+
+#if defined(__SSSE3__)
+  #include <tmmintrin.h>
+#endif
+
+// Emphasized channels stay as-is, while the other channels get darkened.
+// Colors $xE and $xF are black, and stay black.
+// https://wiki.nesdev.com/w/index.php/Colour_emphasis
+ARGBConverter::ARGBConverter(const Color* palette) {
+  const float attenuate = 0.816328f;
+
+  for (uint emphasis = 0; emphasis < 8; emphasis++) {
+    const bool emph_r = emphasis & 1;
+    const bool emph_g = emphasis & 2;
+    const bool emph_b = emphasis & 4;
+
+    for (uint i = 0; i < 64; i++) {
+      float r = palette[i].r;
+      float g = palette[i].g;
+      float b = palette[i].b;
+
+      if ((i & 0x0F) < 0x0E) {
+        if (emph_r) { g *= attenuate; b *= attenuate; }
+        if (emph_g) { r *= attenuate; b *= attenuate; }
+        if (emph_b) { r *= attenuate; g *= attenuate; }
+      }
+
+      this->table[emphasis][i] = Color(u8(r), u8(g), u8(b));
+
+      this->plane[emphasis][0][i] = u8(b);
+      this->plane[emphasis][1][i] = u8(g);
+      this->plane[emphasis][2][i] = u8(r);
+    }
+  }
+}
+
+#if defined(__SSSE3__)
+
+// Looks up 16 6-bit indices in a 64 entry byte table, 16 entries at a time
+static inline __m128i lookup64(const u8* table, __m128i idx, const __m128i* hi) {
+  // pshufb only looks at the low 4 bits of each index (bit 7 isn't set, since
+  // indices are < 64), so pick the right quarter of the table using the top 2
+  __m128i out;
+  out =                   _mm_and_si128(hi[0], _mm_shuffle_epi8(_mm_load_si128((const __m128i*)(table +  0)), idx));
+  out = _mm_or_si128(out, _mm_and_si128(hi[1], _mm_shuffle_epi8(_mm_load_si128((const __m128i*)(table + 16)), idx)));
+  out = _mm_or_si128(out, _mm_and_si128(hi[2], _mm_shuffle_epi8(_mm_load_si128((const __m128i*)(table + 32)), idx)));
+  out = _mm_or_si128(out, _mm_and_si128(hi[3], _mm_shuffle_epi8(_mm_load_si128((const __m128i*)(table + 48)), idx)));
+  return out;
+}
+
+void ARGBConverter::convert(
+  const u8* nes_color,
+  const u8* emphasis,
+  u8* argb,
+  uint pitch
+) const {
+  const __m128i mask_color = _mm_set1_epi8(0x3F);
+  const __m128i mask_hi    = _mm_set1_epi8(0x03);
+  const __m128i alpha      = _mm_set1_epi8(char(0xFF));
+
+  for (uint y = 0; y < 240; y++) {
+    const u8 (&planes)[3][64] = this->plane[emphasis[y] & 7];
+    const u8* src = nes_color + y * 256;
+    u8*       dst = argb + y * pitch;
+
+    for (uint x = 0; x < 256; x += 16) {
+      __m128i idx = _mm_loadu_si128((const __m128i*)(src + x));
+      idx = _mm_and_si128(idx, mask_color);
+
+      const __m128i top = _mm_and_si128(_mm_srli_epi16(idx, 4), mask_hi);
+      const __m128i hi [4] = {
+        _mm_cmpeq_epi8(top, _mm_set1_epi8(0)),
+        _mm_cmpeq_epi8(top, _mm_set1_epi8(1)),
+        _mm_cmpeq_epi8(top, _mm_set1_epi8(2)),
+        _mm_cmpeq_epi8(top, _mm_set1_epi8(3)),
+      };
+
+      const __m128i b = lookup64(planes[0], idx, hi);
+      const __m128i g = lookup64(planes[1], idx, hi);
+      const __m128i r = lookup64(planes[2], idx, hi);
+
+      // interleave into b, g, r, a byte order (i.e: little-endian ARGB8888)
+      const __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+      const __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+      const __m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+      const __m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+
+      __m128i* out = (__m128i*)(dst + x * 4);
+      _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+    }
+  }
+}
+
+#else
+
+void ARGBConverter::convert(
+  const u8* nes_color,
+  const u8* emphasis,
+  u8* argb,
+  uint pitch
+) const {
+  for (uint y = 0; y < 240; y++) {
+    const Color (&table)[64] = this->table[emphasis[y] & 7];
+    const u8* src = nes_color + y * 256;
+    u8*       dst = argb + y * pitch;
+
+    for (uint x = 0; x < 256; x++) {
+      const Color& color = table[src[x] & 0x3F];
+      /* b */ dst[x * 4 + 0] = color.b;
+      /* g */ dst[x * 4 + 1] = color.g;
+      /* r */ dst[x * 4 + 2] = color.r;
+      /* a */ dst[x * 4 + 3] = color.a;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common/util.h"
+#include "color.h"
+
+// NES color -> ARGB8888 conversion
+//
+// The PPU only outputs 6-bit NES colors, plus the PPUMASK color emphasis bits
+// (recorded once per scanline). Turning those into something that can be
+// displayed happens a whole frame at a time, using a 512 entry palette (8
+// emphasis settings x 64 colors), so emphasis is applied for free.
+//
+// When built with SSSE3 (or better) enabled, 16 pixels are converted at a time
+// using byte-shuffle table lookups. Otherwise, there's a plain scalar loop.
+class ARGBConverter {
+private:
+  Color table [8][64]; // [emphasis][nes color]
+  alignas(16) u8 plane [8][3][64]; // table, split into b / g / r bytes
+
+public:
+  ARGBConverter() = delete;
+  ARGBConverter(const Color* palette); // 64 colors, without emphasis
+
+  const Color& lookup(u8 emphasis, u8 nes_color) const {
+    return this->table[emphasis & 7][nes_color & 0x3F];
+  }
+
+  // Converts a 256 x 240 frame of NES colors (with one emphasis value per
+  // line) into ARGB8888 pixels, `pitch` bytes apart per line
+  void convert(
+    const u8* nes_color,
+    const u8* emphasis,
+    u8* argb,
+    uint pitch
+  ) const;
+};
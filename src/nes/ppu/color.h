@@ -1,3 +1,5 @@
+#pragma once
+
 #include "common/util.h"
 #include "common/bitfield.h"
 
@@ -2,6 +2,7 @@
 
 #include "common/util.h"
 #include "nes/interfaces/memory.h"
+#include "nes/wiring/cpu_mmu.h"
 
 #include "common/serializable.h"
 
@@ -9,7 +10,7 @@
 // direct access to the CPU MMU
 class DMA final : public Serializable {
 private:
-  Memory& cpu_mmu;
+  CPU_MMU& cpu_mmu;
 
   u16 addr = 0x0000; // CPU addr to read from
 
@@ -18,7 +19,7 @@ private:
   SERIALIZE_END(1)
 
 public:
-  DMA(Memory& cpu_mmu) : cpu_mmu(cpu_mmu) {}
+  DMA(CPU_MMU& cpu_mmu) : cpu_mmu(cpu_mmu) {}
 
   // Set start-page for DMA
   void start(u8 page) {
@@ -29,4 +30,11 @@ public:
   u8 transfer() {
   	return this->cpu_mmu[this->addr++];
   }
+
+  // If the start-page is side-effect free memory (WRAM, PRG RAM / ROM), returns
+  // a pointer to all 256 bytes of it, so they can be copied in one go.
+  // Otherwise, returns nullptr, and bytes have to be transfer()'d one by one.
+  const u8* direct_page() const {
+  	return this->cpu_mmu.page_table().read[this->addr >> 8];
+  }
 };
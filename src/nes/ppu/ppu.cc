@@ -6,7 +6,7 @@
 
 PPU::PPU(
   const NES_Params& params,
-  Memory& mem,
+  PPU_MMU& mem,
   DMA& dma,
   InterruptLines& interrupts
 ) :
@@ -15,11 +15,45 @@ PPU::PPU(
   mem(mem),
   oam(256, "OAM"),
   oam2(32, "Secondary OAM"),
+  skip_render(false),
+  skip_render_next(false),
+  framebuffer_nes_color_bgr(nullptr),
+  framebuffer_nes_color_spr(nullptr),
+  layer_subscribers(),
+  framebuffer(nullptr),
+  framebuffer_bgr(nullptr),
+  framebuffer_spr(nullptr),
+  framebuffer_stale(~0u),
+  extra_lines(params.ppu_extra_lines),
   fogleman_nmi_hack(params.ppu_timing_hack)
 {
+  memset(&this->sync_stats, 0, sizeof this->sync_stats);
+
+  this->hooks = 0;
+  this->_callbacks.cycle_start.track(&this->hooks, HOOK_CYCLE_START);
+  this->_callbacks.cycle_end  .track(&this->hooks, HOOK_CYCLE_END);
+  this->_callbacks.scanline   .track(&this->hooks, HOOK_SCANLINE);
+  this->_callbacks.frame_start.track(&this->hooks, HOOK_FRAME_START);
+  this->_callbacks.frame_end  .track(&this->hooks, HOOK_FRAME_END);
+  this->_callbacks.read_start .track(&this->hooks, HOOK_READ_START);
+  this->_callbacks.read_end   .track(&this->hooks, HOOK_READ_END);
+  this->_callbacks.write_start.track(&this->hooks, HOOK_WRITE_START);
+  this->_callbacks.write_end  .track(&this->hooks, HOOK_WRITE_END);
+  this->_callbacks.line_writes.track(&this->hooks, HOOK_LINE_WRITES);
+
+  this->write_log.len = 0;
+
   this->power_cycle();
 }
 
+PPU::~PPU() {
+  delete[] this->framebuffer_nes_color_bgr;
+  delete[] this->framebuffer_nes_color_spr;
+  delete[] this->framebuffer;
+  delete[] this->framebuffer_bgr;
+  delete[] this->framebuffer_spr;
+}
+
 void PPU::power_cycle() {
   this->cycles = 0;
   this->frames = 0;
@@ -36,6 +70,23 @@ void PPU::power_cycle() {
   memset(&this->reg, 0, sizeof this->reg);
   this->reg.ppustatus.V = 1; // "often" set
   this->reg.ppustatus.O = 1; // "often" set
+
+  this->spr_line_stale = true;
+  this->spr_line_chr_generation = 0;
+
+  this->bgr_queue.shifts = 0;
+  this->bgr_queue.reloads = 0;
+  this->bgr_queue.stale = true;
+  this->bgr_queue.pal_stale = true;
+  this->bgr_queue_clear_rows();
+
+  this->skip_render = false;
+  this->skip_render_next = false;
+
+  this->overclock_dots = 0;
+
+  this->lag = 0;
+  this->sync_in = this->cycles_until_sync();
 }
 
 void PPU::reset() {
@@ -63,6 +114,18 @@ void PPU::reset() {
   // this->reg.x is unchanged?
 
   this->reg.ppudata = 0x00; // ?
+
+  this->spr_line_stale = true;
+  this->bgr_queue.stale = true;
+  this->bgr_queue_clear_rows();
+
+  this->skip_render = false;
+  this->skip_render_next = false;
+
+  this->overclock_dots = 0;
+
+  this->lag = 0;
+  this->sync_in = this->cycles_until_sync();
 }
 
 // Timing hack grafted from fogleman's nes emulator.
@@ -81,9 +144,67 @@ void PPU::nmiChange() { // hack
 
 uint PPU::getNumFrames() const { return this->frames; }
 
-void PPU::getFramebuff   (const u8** fb) const { if (fb) *fb = this->framebuffer;     }
-void PPU::getFramebuffSpr(const u8** fb) const { if (fb) *fb = this->framebuffer_spr; }
-void PPU::getFramebuffBgr(const u8** fb) const { if (fb) *fb = this->framebuffer_bgr; }
+void PPU::subscribeLayers(uint layers) {
+  if (layers & LAYER_BGR && this->layer_subscribers[0]++ == 0) {
+    this->framebuffer_nes_color_bgr = new u8 [256 * 240] ();
+    this->framebuffer_bgr = new u8 [256 * 4 * 240];
+  }
+  if (layers & LAYER_SPR && this->layer_subscribers[1]++ == 0) {
+    this->framebuffer_nes_color_spr = new u8 [256 * 240] ();
+    this->framebuffer_spr = new u8 [256 * 4 * 240];
+  }
+  this->framebuffer_stale = ~0u;
+}
+
+void PPU::unsubscribeLayers(uint layers) {
+  if (layers & LAYER_BGR && --this->layer_subscribers[0] == 0) {
+    delete[] this->framebuffer_nes_color_bgr;
+    delete[] this->framebuffer_bgr;
+    this->framebuffer_nes_color_bgr = nullptr;
+    this->framebuffer_bgr = nullptr;
+  }
+  if (layers & LAYER_SPR && --this->layer_subscribers[1] == 0) {
+    delete[] this->framebuffer_nes_color_spr;
+    delete[] this->framebuffer_spr;
+    this->framebuffer_nes_color_spr = nullptr;
+    this->framebuffer_spr = nullptr;
+  }
+}
+
+void PPU::copyFramebuff(u8* argb, uint pitch) const {
+  PPU::argb.convert(this->framebuffer_nes_color, this->framebuffer_emphasis,
+    argb, pitch);
+}
+
+void PPU::getFramebuff(const u8** fb) const {
+  if (!fb) return;
+  if (!this->framebuffer) this->framebuffer = new u8 [256 * 4 * 240];
+  if (this->framebuffer_stale & 1) {
+    this->copyFramebuff(this->framebuffer, 256 * 4);
+    this->framebuffer_stale &= ~1u;
+  }
+  *fb = this->framebuffer;
+}
+
+void PPU::getFramebuffBgr(const u8** fb) const {
+  if (!fb) return;
+  if (this->framebuffer_bgr && this->framebuffer_stale & 2) {
+    PPU::argb.convert(this->framebuffer_nes_color_bgr,
+      this->framebuffer_emphasis, this->framebuffer_bgr, 256 * 4);
+    this->framebuffer_stale &= ~2u;
+  }
+  *fb = this->framebuffer_bgr;
+}
+
+void PPU::getFramebuffSpr(const u8** fb) const {
+  if (!fb) return;
+  if (this->framebuffer_spr && this->framebuffer_stale & 4) {
+    PPU::argb.convert(this->framebuffer_nes_color_spr,
+      this->framebuffer_emphasis, this->framebuffer_spr, 256 * 4);
+    this->framebuffer_stale &= ~4u;
+  }
+  *fb = this->framebuffer_spr;
+}
 
 void PPU::getFramebuffNESColor   (const u8** fb) const { if (fb) *fb = this->framebuffer_nes_color;     }
 void PPU::getFramebuffNESColorSpr(const u8** fb) const { if (fb) *fb = this->framebuffer_nes_color_spr; }
@@ -94,10 +215,15 @@ void PPU::getFramebuffNESColorBgr(const u8** fb) const { if (fb) *fb = this->fra
 u8 PPU::read(u16 addr) {
   assert((addr >= 0x2000 && addr <= 0x2007) || addr == 0x4014);
 
-  _callbacks.read_start.run(addr);
-
   using namespace PPURegisters;
 
+  // PPUSTATUS can't have changed since the PPU last caught up (see
+  // cycles_until_sync), so polling it doesn't have to catch the PPU up
+  if (addr != PPUSTATUS || this->fogleman_nmi_hack)
+    this->sync();
+
+  if (this->hooks & HOOK_READ_START) _callbacks.read_start.run(addr);
+
   u8 retval;
 
   switch (addr) {
@@ -107,7 +233,9 @@ u8 PPU::read(u16 addr) {
                     retval = (this->reg.ppustatus.raw & 0xE0)
                            | (this->cpu_data_bus      & 0x1F);
                     // race condition
-                    if (this->scan.line == 241 && this->scan.cycle == 0)
+                    // (vblank is always synced, so the PPU can't be past it)
+                    const uint pos = this->scan.line * 341 + this->scan.cycle;
+                    if (pos + this->lag == 241 * 341 + 0)
                       retval &= ~0x80; // set V to 0 in the retval
                     this->reg.ppustatus.V = false;
                     this->nmiChange(); // hack
@@ -159,7 +287,7 @@ u8 PPU::read(u16 addr) {
 
   this->cpu_data_bus = retval;
 
-  _callbacks.read_end.run(addr, retval);
+  if (this->hooks & HOOK_READ_END) _callbacks.read_end.run(addr, retval);
 
   return retval;
 }
@@ -215,7 +343,22 @@ u8 PPU::peek(u16 addr) const {
 void PPU::write(u16 addr, u8 val) {
   assert((addr >= 0x2000 && addr <= 0x2007) || addr == 0x4014);
 
-  _callbacks.write_start.run(addr, val);
+  this->sync();
+
+  // any register write could affect sprite / background pixels (see spr_line
+  // and bgr_queue)
+  this->spr_line_stale = true;
+  this->bgr_queue.stale = true;
+  this->bgr_queue.pal_stale = true;
+
+  if (this->hooks & HOOK_WRITE_START) _callbacks.write_start.run(addr, val);
+
+  if (this->hooks & HOOK_LINE_WRITES) {
+    if (this->write_log.len == 64) this->flush_write_log();
+    this->write_log.writes[this->write_log.len++] = {
+      addr, val, u16(this->scan.line), u16(this->scan.cycle)
+    };
+  }
 
   using namespace PPURegisters;
 
@@ -303,6 +446,24 @@ void PPU::write(u16 addr, u8 val) {
 
                     // 512 cycles of reading & writing
                     this->dma.start(val);
+
+                    // Fast path: if reading the page has no side-effects, and
+                    // the PPU won't look at OAM mid-transfer (e.g: during
+                    // vblank), copy it all at once, and charge the stall in one
+                    // go, like any other lag (see PPU::run)
+                    const u8* page = this->dma.direct_page();
+                    if (page && !this->reads_oam_within(512 * 3)) {
+                      u8* oam = this->oam.data();
+                      const u8 start = this->reg.oamaddr;
+                      memcpy(oam + start, page, 256 - start);
+                      memcpy(oam, page + (256 - start), start);
+
+                      // OAM changed, and with it the next sprite 0 hit
+                      this->sync_in = this->cycles_until_sync();
+                      this->run(512 * 3);
+                      break;
+                    }
+
                     for (uint i = 0; i < 256; i++) {
                       u8 cpu_val = this->dma.transfer();        CPU_CYCLE();
                       this->oam[this->reg.oamaddr++] = cpu_val; CPU_CYCLE();
@@ -317,11 +478,34 @@ void PPU::write(u16 addr, u8 val) {
                   } break;
   }
 
-  _callbacks.write_end.run(addr, val);
+  // might've changed when the next sprite 0 hit / overflow could happen
+  this->sync_in = this->cycles_until_sync();
+
+  if (this->hooks & HOOK_WRITE_END) _callbacks.write_end.run(addr, val);
 }
 
 /*----------------------------  Helper Functions  ----------------------------*/
 
+// Whether sprite evaluation will read OAM within the next `cycles` PPU cycles
+bool PPU::reads_oam_within(uint cycles) const {
+  if (!this->reg.ppumask.is_rendering) return false;
+
+  // Sprites are evaluated at the start of each rendered line (see spr_fetch)
+  // (<= instead of <, to allow for the odd-frame skipped cycle)
+  uint line = this->scan.line;
+  uint dist = 0;
+  if (this->scan.cycle != 0) {
+    line = (line + 1) % 262;
+    dist = 341 - this->scan.cycle;
+  }
+
+  for (; dist <= cycles; dist += 341, line = (line + 1) % 262)
+    if (line < 240 || line == 261)
+      return true;
+
+  return false;
+}
+
 // TODO: Hardware Accurate
 // For now, it just performs all the calculations on cycle 0 of a scanline.
 void PPU::spr_fetch() {
@@ -442,6 +626,11 @@ void PPU::bgr_fetch() {
 
       this->bgr.shift.at_latch[0] = this->bgr.at_byte & 1;
       this->bgr.shift.at_latch[1] = this->bgr.at_byte & 2;
+
+      this->bgr_queue.reloads++;
+      this->bgr_queue.reloaded_at = this->bgr_queue.shifts;
+      memcpy(this->bgr_queue.loaded, this->bgr_queue.fetched, 8);
+      this->bgr_queue.loaded_ok = this->bgr_queue.fetched_ok;
     } break;
     // 1) Fetch Nametable Byte
     // https://wiki.nesdev.com/w/index.php/PPU_scrolling#Tile_and_attribute_fetching
@@ -471,6 +660,14 @@ void PPU::bgr_fetch() {
                     + this->bgr.nt_byte * 16
                     + this->reg.v.fine_y;
 
+      // The bitplanes still have to be read through the mapper (for A12
+      // clocking / CHR latches), but the tile's pixels come from the decoded
+      // CHR cache, as mapped right before the fetch (see case 0)
+      const ChrTable& chr = this->mem.chr_tiles();
+      memcpy(this->bgr_queue.fetched, chr.row(tile_addr, false), 8);
+      this->bgr_queue.fetched_addr = tile_addr;
+      this->bgr_queue.fetched_generation = chr.generation;
+
       this->bgr.tile_lo = this->mem[tile_addr + 0];
     } break;
 
@@ -480,6 +677,15 @@ void PPU::bgr_fetch() {
                     + this->bgr.nt_byte * 16
                     + this->reg.v.fine_y;
 
+      // The decoded row only matches the bitplanes if nothing moved in between
+      // (i.e: a mid-fetch write, or a bank switch triggered by the lo fetch).
+      // Mappers only switch banks _after_ a read (see Mapper_009::read).
+      const ChrTable& chr = this->mem.chr_tiles();
+      this->bgr_queue.fetched_ok =
+        this->bgr_queue.fetched_addr == tile_addr &&
+        this->bgr_queue.fetched_generation == chr.generation;
+      this->bgr_queue.fetched_addr = 0xFFFF;
+
       this->bgr.tile_hi = this->mem[tile_addr + 8];
 
       // increment Coarse X
@@ -546,15 +752,7 @@ void PPU::bgr_fetch() {
 /*-----------------------  Pixel Evaluation Functions  -----------------------*/
 
 // https://wiki.nesdev.com/w/index.php/PPU_rendering
-PPU::Pixel PPU::get_bgr_pixel() {
-  assert(this->scan.line < 240 || this->scan.line == 261);
-
-  uint pixel_type = (nth_bit(this->bgr.shift.tile[1], 15 - this->reg.x) << 1)
-                  | (nth_bit(this->bgr.shift.tile[0], 15 - this->reg.x) << 0);
-
-  uint palette = (nth_bit(this->bgr.shift.at[1], 7 - this->reg.x) << 1)
-               | (nth_bit(this->bgr.shift.at[0], 7 - this->reg.x) << 0);
-
+void PPU::bgr_shift() {
   // Shift Background registers
   if (in_range(this->scan.cycle, 1,   256) ||
       in_range(this->scan.cycle, 321, 336))
@@ -566,7 +764,26 @@ PPU::Pixel PPU::get_bgr_pixel() {
     this->bgr.shift.at[0] |= u8(this->bgr.shift.at_latch[0]);
     this->bgr.shift.at[1] <<= 1;
     this->bgr.shift.at[1] |= u8(this->bgr.shift.at_latch[1]);
+
+    this->bgr_queue.shifts++;
   }
+}
+
+PPU::Pixel PPU::get_bgr_pixel() {
+  assert(this->scan.line < 240 || this->scan.line == 261);
+
+  // Pixels are only output on dots 2 - 257
+  if (this->scan.cycle - 2 > 255) {
+    this->bgr_shift();
+    return Pixel();
+  }
+
+  if (this->bgr_queue_outdated())
+    this->bgr_queue_update();
+
+  const Pixel pixel = this->bgr_queue.px[this->bgr_queue.shifts + this->reg.x];
+
+  this->bgr_shift();
 
   // Check for background mask disable
   if (!this->reg.ppumask.m && (this->scan.cycle - 2) < 8)
@@ -576,124 +793,128 @@ PPU::Pixel PPU::get_bgr_pixel() {
   if (this->reg.ppumask.b == false || this->scan.line >= 240)
     return Pixel();
 
-  return Pixel {
-    pixel_type != 0,
-    this->mem[0x3F00 + palette * 4 + pixel_type],
-    0
-  };
+  return pixel;
 }
 
-// TODO: make this more "hardware" accurate.
-// https://wiki.nesdev.com/w/index.php/PPU_rendering
-PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
-  const int x = this->scan.cycle - 2;
+// Brings the background pixel queue up to date with the shift registers
+void PPU::bgr_queue_update() {
+  if (this->bgr_queue.pal_stale) {
+    for (uint i = 0; i < 32; i++)
+      this->bgr_queue.pal[i] = this->mem.peek(0x3F00 + i);
+    this->bgr_queue.pal_stale = false;
+  }
 
   if (
-    this->reg.ppumask.s == false || // Is sprite rendering is disabled
-    (!this->reg.ppumask.M && x < 8) // Is sprite mask enabled + in range of it?
-  ) return Pixel();
-
-  // Scan through OAM2 to see if there is a sprite to draw at this scan.cycle
-  for (uint sprite = 0; sprite < 8; sprite++) {
-    // Read sprite data
-    u8 y_pos      = this->oam2[sprite * 4 + 0];
-    u8 tile_index = this->oam2[sprite * 4 + 1];
-    union {
-      u8 val;
-      BitField<0, 2> palette;
-    //BitField<2, 3> unimplemented;
-      BitField<5> priority;
-      BitField<6> flip_horizontal;
-      BitField<7> flip_vertical;
-    } attributes  { this->oam2[sprite * 4 + 2] };
-    u8 x_pos      = this->oam2[sprite * 4 + 3];
-
-    // If the sprite is invalid (i.e: all 0xFF), stop scanning, since we are out
-    // of sprites
-    if (
-      0xFF == y_pos &&
-      0xFF == x_pos &&
-      0xFF == tile_index &&
-      0xFF == attributes.val
-    ) break;
-
-    // Does this sprite have a pixel at the current x addr?
-    bool x_in_range = in_range(int(x_pos), int(x) - 7, int(x));
-    if (!x_in_range)
-      continue;
-
-    // Cool! There is a sprite here!
-
-    // Now we just need to get the actual pixel data for this sprite...
-    // First, which pixel of the sprite are we rendering?
-    uint spr_row = this->scan.line - y_pos - 1;
-    uint spr_col = 7 - (x - x_pos);
-
-    const uint sprite_height = this->reg.ppuctrl.H ? 16 : 8;
-    if (attributes.flip_vertical)   spr_row = sprite_height - 1 - spr_row;
-    if (attributes.flip_horizontal) spr_col =             8 - 1 - spr_col;
-
-    // Time to get the pixel type yo!
-
-    // NOTE: I completely overlooked handling 8x16 sprites for a very long
-    //       time. I did manage to figure it out though!
+    !this->bgr_queue.stale &&
+    this->bgr_queue.reloads == 1 &&
+    this->bgr_queue.reloaded_at == 8 &&
+    this->bgr_queue.shifts == 8
+  ) {
+    // The usual case: the next tile slid into place, and a new one got loaded
+    // in right behind it
+    for (uint i = 0; i < 8; i++)
+      this->bgr_queue.px[i] = this->bgr_queue.px[i + 8];
+    this->bgr_queue_decode(8,
+      this->bgr_queue.loaded_ok ? this->bgr_queue.loaded : nullptr);
+  } else {
+    this->bgr_queue_decode(0);
+    this->bgr_queue_decode(8);
+  }
 
-    // When in 8x16 sprite mode, the sprite_table to use is solely dependant
-    // on odd/eveness of the tile_index
-    bool sprite_table = !this->reg.ppuctrl.H
-      ? this->reg.ppuctrl.S
-      : tile_index & 1;
+  this->bgr_queue.shifts = 0;
+  this->bgr_queue.reloads = 0;
+  this->bgr_queue.stale = false;
+}
 
-    if (this->reg.ppuctrl.H) {
-      tile_index &= 0xFE;
-      // And if we have finished the top half, read from adjacent tile
-      if (spr_row > 7) {
-        tile_index++;
-        spr_row -= 8;
-      }
-    }
+// Decodes the group of 8 pixels the shift registers would output from
+// position `first` onwards (without any further reloads), taking the pixel
+// types from an already decoded tile row, if there is one
+void PPU::bgr_queue_decode(uint first, const u8* row) {
+  const u8* pal = this->bgr_queue.pal;
+
+  for (uint i = first; i < first + 8; i++) {
+    const uint pixel_type = row
+      ? row[i - first]
+      : (nth_bit(this->bgr.shift.tile[1], 15 - i) << 1)
+      | (nth_bit(this->bgr.shift.tile[0], 15 - i) << 0);
+
+    // pixels past the attribute shift registers use what'll be shifted in
+    const uint palette = i < 8
+      ? (nth_bit(this->bgr.shift.at[1], 7 - i) << 1)
+      | (nth_bit(this->bgr.shift.at[0], 7 - i) << 0)
+      : (this->bgr.shift.at_latch[1] << 1)
+      | (this->bgr.shift.at_latch[0] << 0);
+
+    this->bgr_queue.px[i] = Pixel {
+      pixel_type != 0,
+      pal[palette * 4 + pixel_type],
+      0
+    };
+  }
+}
 
-    u16 tile_addr = (0x1000 * sprite_table) + (tile_index * 16) + spr_row;
-    u8 lo_bp = this->mem.peek(tile_addr + 0);
-    u8 hi_bp = this->mem.peek(tile_addr + 8);
-    u8 pixel_type = nth_bit(lo_bp, spr_col) + (nth_bit(hi_bp, spr_col) << 1);
+// TODO: make this more "hardware" accurate.
+// https://wiki.nesdev.com/w/index.php/PPU_rendering
+PPU::Pixel PPU::get_spr_pixel(PPU::Pixel& bgr_pixel) {
+  const uint x = this->scan.cycle - 2;
+  if (x > 255) return Pixel();
+
+  // (Re)draw the sprite line buffer, if need be
+  const ChrTable& chr = this->mem.chr_tiles();
+  if (this->spr_line_stale || this->spr_line_chr_generation != chr.generation) {
+    u8 pal [32];
+    for (uint i = 0; i < 32; i++)
+      pal[i] = this->mem.peek(0x3F00 + i);
+
+    this->draw_spr_line(this->spr_line, pal, x);
+    this->spr_line_stale = false;
+    this->spr_line_chr_generation = chr.generation;
+  }
 
-    // If the pixel is transparent, continue looking for a sprite to render...
-    if (pixel_type == 0)
-      continue;
+  const SprLinePixel& spr_pixel = this->spr_line[x];
+  if (!spr_pixel.is_on) return Pixel();
 
-    // The rules for Sprite0 hit are fairly involved...
-    // You can only get a sprite 0 hit when:
-    if (
-      sprite == 0 &&                    // This is sprite-slot 0
-      this->spr.spr_zero_on_line &&     // And Sprite 0 is on the line
-      this->reg.ppumask.is_rendering && // And rendering is enabled
-      this->reg.ppustatus.S == 0 &&     // And there has not been a spr hit
-      (x_pos != 0xFF && x < 0xFF) &&    // And not when dot/spr is at 255
-      bgr_pixel.is_on                   // And the bgr pixel is on
-    ) this->reg.ppustatus.S = 1; // Only then does sprite hit occur
-
-    // Otherwise, fetch which pallete color to use, and return the pixel!
-    return Pixel {
-      true,
-      this->mem.peek(0x3F10 + attributes.palette * 4 + pixel_type),
-      bool(attributes.priority)
-    };
-  }
+  // The rules for Sprite0 hit are fairly involved...
+  // You can only get a sprite 0 hit when:
+  if (
+    spr_pixel.is_zero &&              // This is sprite-slot 0 (not at x 255)
+    this->spr.spr_zero_on_line &&     // And Sprite 0 is on the line
+    this->reg.ppumask.is_rendering && // And rendering is enabled
+    this->reg.ppustatus.S == 0 &&     // And there has not been a spr hit
+    x < 0xFF &&                       // And not when dot is at 255
+    bgr_pixel.is_on                   // And the bgr pixel is on
+  ) this->reg.ppustatus.S = 1; // Only then does sprite hit occur
 
-  // if nothing was found, return a empty pixel
-  return Pixel();
+  return Pixel {
+    true,
+    spr_pixel.nes_color,
+    spr_pixel.priority
+  };
 }
 
 /*----------------------------  Core Render Loop  ----------------------------*/
 
 void PPU::cycle() {
-  _callbacks.cycle_start.run();
+  // Extra (overclocked) lines don't do anything at all
+  if (this->overclock_dots) {
+    this->overclock_dots--;
+    this->cycles += 1; // the CPU is still running though (e.g: for OAM DMA)
+    return;
+  }
+
+  if (this->hooks & HOOK_CYCLE_START) _callbacks.cycle_start.run();
 
   if (this->scan.line < 240 || this->scan.line == 261) {
     // Calculate Pixels
-    PPU::Pixel bgr_pixel = this->get_bgr_pixel();
-    PPU::Pixel spr_pixel = this->get_spr_pixel(bgr_pixel);
+    // (skipped frames only need them while a sprite zero hit could happen)
+    PPU::Pixel bgr_pixel = Pixel();
+    PPU::Pixel spr_pixel = Pixel();
+    if (!this->skip_render || this->spr_zero_pending()) {
+      bgr_pixel = this->get_bgr_pixel();
+      spr_pixel = this->get_spr_pixel(bgr_pixel);
+    } else {
+      this->bgr_shift();
+    }
 
     // Perform data fetches
     if (this->reg.ppumask.is_rendering) {
@@ -701,51 +922,43 @@ void PPU::cycle() {
       this->spr_fetch();
     }
 
-    // Priority Multiplexer decision table
-    // https://wiki.nesdev.com/w/index.php/PPU_rendering#Preface
-    // BG pixel | Sprite pixel | Priority | Output
-    // --------------------------------------------
-    // 0        | 0            | X        | BG ($3F00)
-    // 0        | 1-3          | X        | Sprite
-    // 1-3      | 0            | X        | BG
-    // 1-3      | 1-3          | 0        | Sprite
-    // 1-3      | 1-3          | 1        | BG
-
-    const bool bgr_on = bgr_pixel.is_on;
-    const bool spr_on = spr_pixel.is_on;
-
-    u8 nes_color = 0x00;
-    /**/ if (!bgr_on && !spr_on) nes_color = this->mem[0x3F00];
-    else if (!bgr_on &&  spr_on) nes_color = spr_pixel.nes_color;
-    else if ( bgr_on && !spr_on) nes_color = bgr_pixel.nes_color;
-    else if ( bgr_on &&  spr_on) nes_color = spr_pixel.priority
-                                              ? bgr_pixel.nes_color
-                                              : spr_pixel.nes_color;
-
-    u8 nes_color_bgr = bgr_on ? bgr_pixel.nes_color : this->mem.peek(0x3F00);
-    u8 nes_color_spr = spr_on ? spr_pixel.nes_color : this->mem.peek(0x3F00);
-
-    const uint x = (this->scan.cycle - 2);
-    const uint y = this->scan.line;
-
-    if (x < 256 && y != 261) {
-      framebuffer_nes_color    [y * 256 + x] = nes_color;
-      framebuffer_nes_color_bgr[y * 256 + x] = nes_color_bgr;
-      framebuffer_nes_color_spr[y * 256 + x] = nes_color_spr;
-
-      // raw NES colors are hard to render, so let's also do RGB translation.
-      // that way, we can directly pass the framebuffer to our rendering layer
-      const uint offset = (256 * 4 * y) + (4 * x);
-      #define draw_dot(buf, color) \
-        /* b */ buf[offset + 0] = color.b; \
-        /* g */ buf[offset + 1] = color.g; \
-        /* r */ buf[offset + 2] = color.r; \
-        /* a */ buf[offset + 3] = color.a;
-
-      draw_dot(framebuffer,     this->palette[nes_color     % 64]);
-      draw_dot(framebuffer_bgr, this->palette[nes_color_bgr % 64]);
-      draw_dot(framebuffer_spr, this->palette[nes_color_spr % 64]);
-      #undef draw_dot
+    if (!this->skip_render) {
+      // Priority Multiplexer decision table
+      // https://wiki.nesdev.com/w/index.php/PPU_rendering#Preface
+      // BG pixel | Sprite pixel | Priority | Output
+      // --------------------------------------------
+      // 0        | 0            | X        | BG ($3F00)
+      // 0        | 1-3          | X        | Sprite
+      // 1-3      | 0            | X        | BG
+      // 1-3      | 1-3          | 0        | Sprite
+      // 1-3      | 1-3          | 1        | BG
+
+      const bool bgr_on = bgr_pixel.is_on;
+      const bool spr_on = spr_pixel.is_on;
+
+      u8 nes_color = 0x00;
+      /**/ if (!bgr_on && !spr_on) nes_color = this->mem[0x3F00];
+      else if (!bgr_on &&  spr_on) nes_color = spr_pixel.nes_color;
+      else if ( bgr_on && !spr_on) nes_color = bgr_pixel.nes_color;
+      else if ( bgr_on &&  spr_on) nes_color = spr_pixel.priority
+                                                ? bgr_pixel.nes_color
+                                                : spr_pixel.nes_color;
+
+      const uint x = (this->scan.cycle - 2);
+      const uint y = this->scan.line;
+
+      if (x < 256 && y != 261) {
+        framebuffer_nes_color[y * 256 + x] = nes_color;
+
+        if (framebuffer_nes_color_bgr)
+          framebuffer_nes_color_bgr[y * 256 + x] = bgr_on
+            ? bgr_pixel.nes_color
+            : this->mem.peek(0x3F00);
+        if (framebuffer_nes_color_spr)
+          framebuffer_nes_color_spr[y * 256 + x] = spr_on
+            ? spr_pixel.nes_color
+            : this->mem.peek(0x3F00);
+      }
     }
   }
 
@@ -763,7 +976,7 @@ void PPU::cycle() {
   if (this->scan.cycle == 1) {
     // vblank start on line 241...
     if (this->scan.line == 241) {
-      _callbacks.frame_end.run();
+      if (this->hooks & HOOK_FRAME_END) _callbacks.frame_end.run();
 
       // MAJOR KEY: The vblank flag is _always_ set!
       this->reg.ppustatus.V = true;
@@ -777,7 +990,7 @@ void PPU::cycle() {
 
     // ...and is cleared in the pre-render line
     if (this->scan.line == 261) {
-      _callbacks.frame_start.run();
+      if (this->hooks & HOOK_FRAME_START) _callbacks.frame_start.run();
 
       this->reg.ppustatus.V = false;
       this->reg.ppustatus.S = false;
@@ -802,10 +1015,21 @@ void PPU::cycle() {
 
   // Check to see if the cycle has finished
   if (this->scan.cycle > 340) {
-    _callbacks.scanline.run();
+    if (this->write_log.len) this->flush_write_log();
+    if (this->hooks & HOOK_SCANLINE) _callbacks.scanline.run();
+    if (this->scan.line < 240)
+      this->framebuffer_emphasis[this->scan.line] = this->reg.ppumask.raw >> 5;
+    this->spr_line_stale = true;
     // update scanline tracking vars
     this->scan.cycle = 0;
     this->scan.line += 1;
+    this->framebuffer_stale = ~0u;
+    // extra lines go right after the post-render line (see extra_lines)
+    if (this->scan.line == 241)
+      this->overclock_dots = this->extra_lines * 341;
+    // frame skipping only changes between frames (see skipRender)
+    if (this->scan.line == 261)
+      this->skip_render = this->skip_render_next;
     // check for rollover
     if (this->scan.line > 261) {
       this->scan.line = 0;
@@ -815,7 +1039,392 @@ void PPU::cycle() {
     }
   }
 
-  _callbacks.cycle_end.run();
+  if (this->hooks & HOOK_CYCLE_END) _callbacks.cycle_end.run();
+}
+
+void PPU::flush_write_log() {
+  _callbacks.line_writes.run(this->write_log.writes, this->write_log.len);
+  this->write_log.len = 0;
+}
+
+/*---------------------------  Scanline Renderer  ----------------------------*/
+
+// Whenever a whole visible scanline can run without the CPU getting a chance
+// to poke at the PPU (see PPU::sync), the scanline is drawn in one go, instead
+// of dot-by-dot.
+//
+// Every fetch (and every internal register update) still happens in the same
+// order as in PPU::cycle, so mappers see the exact same PPU bus traffic, and
+// the PPU ends up in the exact same state. The savings come from working out
+// pixels without any virtual memory accesses: palette RAM is snapshotted once
+// per line, and sprites are drawn into a line buffer up front, instead of
+// searching secondary OAM for every single dot.
+
+bool PPU::can_render_scanline() const {
+  return this->scan.cycle == 0
+      && this->scan.line < 240
+      && !this->fogleman_nmi_hack // nmi_delay counts down every dot
+      && !(this->hooks & (HOOK_CYCLE_START | HOOK_CYCLE_END));
+}
+
+// Draws the sprites on the current line (as per secondary OAM) into a line
+// buffer, replacing any pixels from `from_x` onwards.
+// Earlier sprites take priority, so only the first opaque pixel at each x is
+// kept (see get_spr_pixel).
+void PPU::draw_spr_line(SprLinePixel* spr_line, const u8* pal, uint from_x) {
+  for (uint x = from_x; x < 256; x++)
+    spr_line[x] = SprLinePixel();
+
+  if (!this->reg.ppumask.s) return;
+
+  const ChrTable& chr = this->mem.chr_tiles();
+  const uint sprite_height = this->reg.ppuctrl.H ? 16 : 8;
+
+  for (uint sprite = 0; sprite < 8; sprite++) {
+    u8 y_pos      = this->oam2.peek(sprite * 4 + 0);
+    u8 tile_index = this->oam2.peek(sprite * 4 + 1);
+    union {
+      u8 val;
+      BitField<0, 2> palette;
+    //BitField<2, 3> unimplemented;
+      BitField<5> priority;
+      BitField<6> flip_horizontal;
+      BitField<7> flip_vertical;
+    } attributes  { this->oam2.peek(sprite * 4 + 2) };
+    u8 x_pos      = this->oam2.peek(sprite * 4 + 3);
+
+    if (
+      0xFF == y_pos &&
+      0xFF == x_pos &&
+      0xFF == tile_index &&
+      0xFF == attributes.val
+    ) break;
+
+    uint spr_row = this->scan.line - y_pos - 1;
+    if (attributes.flip_vertical) spr_row = sprite_height - 1 - spr_row;
+
+    bool sprite_table = !this->reg.ppuctrl.H
+      ? this->reg.ppuctrl.S
+      : tile_index & 1;
+
+    if (this->reg.ppuctrl.H) {
+      tile_index &= 0xFE;
+      if (spr_row > 7) {
+        tile_index++;
+        spr_row -= 8;
+      }
+    }
+
+    u16 tile_addr = (0x1000 * sprite_table) + (tile_index * 16) + spr_row;
+    const u8* row = chr.row(tile_addr, attributes.flip_horizontal);
+
+    for (uint col = 0; col < 8; col++) {
+      const uint x = x_pos + col;
+      if (x < from_x || x > 255 || spr_line[x].is_on) continue;
+      if (!this->reg.ppumask.M && x < 8) continue;
+
+      const u8 pixel_type = row[col];
+      if (pixel_type == 0) continue;
+
+      spr_line[x].is_on     = true;
+      spr_line[x].nes_color = pal[0x10 + attributes.palette * 4 + pixel_type];
+      spr_line[x].priority  = attributes.priority;
+      spr_line[x].is_zero   = sprite == 0 && x_pos != 0xFF;
+    }
+  }
+}
+
+void PPU::render_scanline() {
+  assert(this->can_render_scanline());
+
+  const uint line = this->scan.line;
+  const bool is_rendering = this->reg.ppumask.is_rendering;
+
+  // Dot 0 - Sprite evaluation
+  if (is_rendering) {
+    this->bgr_fetch();
+    this->spr_fetch();
+  }
+
+  // Skipped frames only need pixels while a sprite zero hit could happen
+  const bool draw = !this->skip_render || this->spr_zero_pending();
+
+  // Palette RAM can't change mid-line (that requires a PPUDATA write)
+  u8 pal [32];
+  if (draw) {
+    for (uint i = 0; i < 32; i++)
+      pal[i] = this->mem.peek(0x3F00 + i);
+  }
+
+  SprLinePixel* spr_line = this->spr_line;
+  if (draw) this->draw_spr_line(spr_line, pal, 0);
+
+  const ChrTable& chr = this->mem.chr_tiles();
+  uint chr_generation = chr.generation;
+
+  // Dots 1 - 340
+  // Pixel x is output on dot x + 2, using the background shift registers as
+  // they were _before_ that dot's shift / fetch.
+  for (uint dot = 1; dot <= 340; dot++) {
+    this->scan.cycle = dot;
+
+    const uint x = dot - 2;
+    if (x < 256 && draw) {
+      const uint fine_x = this->reg.x;
+      const uint pixel_type = (nth_bit(this->bgr.shift.tile[1], 15 - fine_x) << 1)
+                            | (nth_bit(this->bgr.shift.tile[0], 15 - fine_x) << 0);
+      const uint palette = (nth_bit(this->bgr.shift.at[1], 7 - fine_x) << 1)
+                         | (nth_bit(this->bgr.shift.at[0], 7 - fine_x) << 0);
+
+      const bool bgr_on = pixel_type != 0
+        && this->reg.ppumask.b
+        && (this->reg.ppumask.m || x >= 8);
+      const bool spr_on = spr_line[x].is_on;
+
+      if (
+        spr_on && spr_line[x].is_zero &&
+        this->spr.spr_zero_on_line &&
+        is_rendering &&
+        this->reg.ppustatus.S == 0 &&
+        x < 0xFF &&
+        bgr_on
+      ) this->reg.ppustatus.S = 1;
+
+      if (!this->skip_render) {
+        const u8 bgr_color = pal[palette * 4 + pixel_type];
+
+        u8 nes_color = 0x00;
+        /**/ if (!bgr_on && !spr_on) nes_color = pal[0];
+        else if (!bgr_on &&  spr_on) nes_color = spr_line[x].nes_color;
+        else if ( bgr_on && !spr_on) nes_color = bgr_color;
+        else if ( bgr_on &&  spr_on) nes_color = spr_line[x].priority
+                                                  ? bgr_color
+                                                  : spr_line[x].nes_color;
+
+        framebuffer_nes_color[line * 256 + x] = nes_color;
+
+        if (framebuffer_nes_color_bgr)
+          framebuffer_nes_color_bgr[line * 256 + x] = bgr_on ? bgr_color : pal[0];
+        if (framebuffer_nes_color_spr)
+          framebuffer_nes_color_spr[line * 256 + x] = spr_on
+            ? spr_line[x].nes_color
+            : pal[0];
+      }
+    }
+
+    // Shift Background registers (see bgr_shift)
+    if (dot <= 256 || in_range(dot, 321, 336)) {
+      this->bgr.shift.tile[0] <<= 1;
+      this->bgr.shift.tile[1] <<= 1;
+
+      this->bgr.shift.at[0] <<= 1;
+      this->bgr.shift.at[0] |= u8(this->bgr.shift.at_latch[0]);
+      this->bgr.shift.at[1] <<= 1;
+      this->bgr.shift.at[1] |= u8(this->bgr.shift.at_latch[1]);
+    }
+
+    if (is_rendering) {
+      this->bgr_fetch();
+      if (in_range(dot, 257, 320))
+        this->spr_fetch();
+    }
+
+    // Some mappers switch CHR banks in response to PPU fetches (e.g: MMC2's
+    // latches), which affects the rest of the line's sprite pixels
+    if (chr.generation != chr_generation && dot < 257 && draw) {
+      chr_generation = chr.generation;
+      this->draw_spr_line(spr_line, pal, dot - 1);
+    }
+  }
+
+  // ---- Update Counter ---- //
+
+  this->cycles += 341;
+
+  if (this->write_log.len) this->flush_write_log();
+  if (this->hooks & HOOK_SCANLINE) _callbacks.scanline.run();
+  this->framebuffer_emphasis[line] = this->reg.ppumask.raw >> 5;
+  this->spr_line_stale = true;
+  this->bgr_queue.stale = true; // (the scanline renderer doesn't keep it up)
+  this->scan.cycle = 0;
+  this->scan.line += 1;
+  this->framebuffer_stale = ~0u;
+}
+
+uint PPU::cycles_until_event() const {
+  // Positions (line * 341 + cycle) of the cycles where vblank starts, and
+  // where the frame rolls over (one cycle early, in case of an odd-frame skip)
+  const uint vblank   = 241 * 341 + 1;
+  const uint rollover = 261 * 341 + 339;
+
+  const uint pos = this->scan.line * 341 + this->scan.cycle;
+
+  uint cycles;
+  /**/ if (this->overclock_dots) cycles = this->overclock_dots;
+  else if (pos <= vblank)         cycles = vblank   - pos + 1;
+  else if (pos <= rollover)       cycles = rollover - pos + 1;
+  else                            cycles = 1;
+
+  // extra lines start once the post-render line is done
+  const uint post_render_end = 240 * 341 + 340;
+  if (this->extra_lines && pos <= post_render_end)
+    if (post_render_end - pos + 1 < cycles) cycles = post_render_end - pos + 1;
+
+  // the NMI timing hack fires NMIs some cycles after vblank
+  if (this->fogleman_nmi_hack && this->nmi_delay > 0)
+    if (uint(this->nmi_delay) < cycles) cycles = this->nmi_delay;
+
+  // The PPU always catches up before any of these happen (see
+  // cycles_until_sync), so the PPU is never this far behind
+  return cycles - this->lag;
+}
+
+// With the usual pattern table layout (background at $0000, 8x8 sprites at
+// $1000), A12 rises exactly once per rendered line, on the first sprite pattern
+// fetch (see spr_fetch), and background fetches bring it back down. Any other
+// layout depends on which tiles get fetched, so it isn't predicted.
+uint PPU::cycles_until_a12_rises(uint n) const {
+  // Turning rendering back on takes a PPUMASK write, which is re-predicted
+  if (!this->reg.ppumask.is_rendering) return UINT_MAX;
+
+  const bool usual_layout =
+    !this->reg.ppuctrl.B && this->reg.ppuctrl.S && !this->reg.ppuctrl.H;
+  if (n == 0 || !usual_layout) return 0;
+
+  const uint rise = 261; // dot of the first sprite pattern fetch
+
+  const uint line = this->scan.line;
+  const uint dot  = this->scan.cycle;
+  const bool rendered = line < 240 || line == 261;
+
+  // Rendering got turned on mid-way through the sprite fetches (or the CPU
+  // read some CHR), so the very next sprite fetch is a rising edge
+  if (rendered && in_range(dot, 262, 319) && !this->mem.a12())
+    return 1;
+
+  // Rendered lines are counted from the pre-render line, i.e: rising edge 0
+  // is on line 261, and rising edges 1 ... 240 are on lines 0 ... 239
+  uint next;   // the next rising edge
+  uint cycles; // cycles until the next rising edge
+  /**/ if (this->overclock_dots) { // sitting on 241:0 (see PPU::cycle)
+    next = 0;
+    cycles = this->overclock_dots + (261 - 241) * 341 + rise + 1;
+  }
+  else if (rendered && dot <= rise) {
+    next = line == 261 ? 0 : line + 1;
+    cycles = rise - dot + 1;
+  }
+  else if (line == 261 || line < 239) {
+    next = line == 261 ? 1 : line + 2;
+    cycles = 341 - dot + rise + 1;
+  }
+  else { // on to the next pre-render line
+    next = 0;
+    cycles = (261 - line) * 341 - dot + rise + 1;
+    if (line <= 240) cycles += this->extra_lines * 341;
+  }
+
+  const uint last = next + n - 1;
+  const uint frames = last / 241; // frame rollovers along the way
+
+  cycles += (n - 1) * 341;
+  cycles += frames * (262 - 241 + this->extra_lines) * 341;
+
+  // Pre-render lines that might skip their last cycle (on odd frames)
+  uint skips = (last + 240) / 241;
+  if (line < 240 && next != 0) skips--; // this frame's is behind us already
+  cycles -= skips;
+
+  return cycles;
+}
+
+/*----------------------------  Lazy Catch-up  -------------------------------*/
+
+void PPU::run(uint cycles) {
+  this->lag += cycles;
+  if (this->lag >= this->sync_in)
+    this->sync();
+}
+
+void PPU::sync() {
+  if (this->lag) {
+    this->sync_stats.syncs++;
+    this->sync_stats.cycles += this->lag;
+
+    while (this->lag) {
+      // Whole lines without any register writes can be drawn in one go
+      if (this->lag >= 341 && this->can_render_scanline()) {
+        this->render_scanline();
+        this->sync_stats.fast_lines++;
+        this->lag -= 341;
+        continue;
+      }
+
+      this->cycle();
+      this->lag--;
+    }
+  }
+
+  this->sync_in = this->cycles_until_sync();
+}
+
+uint PPU::cycles_until_sync() const {
+  // The NMI hack's delayed NMIs are too finicky to predict
+  if (this->fogleman_nmi_hack) return 1;
+
+  const uint pos = this->scan.line * 341 + this->scan.cycle;
+
+  // vblank / NMIs, and frame ends
+  uint cycles = this->cycles_until_event() + this->lag;
+
+  // PPUSTATUS is cleared at the start of the pre-render line
+  const uint prerender = 261 * 341 + 1;
+  if (pos <= prerender && prerender - pos + 1 < cycles)
+    cycles = prerender - pos + 1;
+
+  if (!this->reg.ppumask.is_rendering)
+    return cycles;
+
+  const uint height = this->reg.ppuctrl.H ? 16 : 8;
+
+  // Sprite 0 hits can happen on any line sprite 0 is on (which is found at the
+  // start of each line)
+  if (!this->reg.ppustatus.S) {
+    const uint first = this->oam.peek(0) + 1;
+    const uint last  = this->oam.peek(0) + height;
+
+    if (this->scan.line < 240) {
+      /**/ if (this->spr.spr_zero_on_line)                cycles = 1;
+      else if (in_range(this->scan.line, first, last))     cycles = 1;
+      else if (this->scan.line < first && first < 240) {
+        if (first * 341 - pos + 1 < cycles) cycles = first * 341 - pos + 1;
+      }
+    }
+  }
+
+  // Sprite overflow happens at the start of any line with more than 8 sprites
+  if (!this->reg.ppustatus.O) {
+    // change in the number of sprites on each line, vs the previous line
+    int delta [256 + 1 + 16] = {0};
+    for (uint sprite = 0; sprite < 64; sprite++) {
+      const uint y = this->oam.peek(sprite * 4);
+      delta[y + 1]++;
+      delta[y + 1 + height]--;
+    }
+
+    int count = 0;
+    for (uint line = 0; line < 262; line++) {
+      count += delta[line];
+      if (count <= 8 || (line >= 240 && line != 261)) continue;
+
+      if (line * 341 >= pos) {
+        if (line * 341 - pos + 1 < cycles) cycles = line * 341 - pos + 1;
+        break;
+      }
+    }
+  }
+
+  return cycles;
 }
 
 /*---------------------------------  Palette  --------------------------------*/
@@ -830,3 +1439,5 @@ const Color PPU::palette [64] = {
   0xFFFEFF, 0xC0DFFF, 0xD3D2FF, 0xE8C8FF, 0xFBC2FF, 0xFEC4EA, 0xFECCC5, 0xF7D8A5,
   0xE4E594, 0xCFEF96, 0xBDF4AB, 0xB3F3CC, 0xB5EBF2, 0xB8B8B8, 0x000000, 0x000000,
 };
+
+const ARGBConverter PPU::argb (PPU::palette);
@@ -6,10 +6,12 @@
 #include "common/util.h"
 #include "nes/interfaces/memory.h"
 
+#include "argb.h"
 #include "color.h"
 #include "dma.h"
 #include "nes/generic/ram/ram.h"
 #include "nes/wiring/interrupt_lines.h"
+#include "nes/wiring/ppu_mmu.h"
 
 #include "nes/params.h"
 
@@ -59,7 +61,7 @@ private:
   // ---- Core Hardware ---- //
 
   InterruptLines& interrupts;
-  Memory& mem; // PPU 16 bit address space (should be wired to ppu_mmu)
+  PPU_MMU& mem; // PPU 16 bit address space
 
   // ---- Sprite Hardware ---- //
 
@@ -196,21 +198,110 @@ private:
   Pixel get_bgr_pixel();
   Pixel get_spr_pixel(Pixel& bgr_pixel);
 
+  void bgr_shift();
+
+  // Background pixel queue
+  // Instead of picking bits out of the background shift registers every dot,
+  // each tile gets decoded into a group of 8 pixels when it's loaded into the
+  // shift registers. A dot's pixel is then just the one at fine X, offset by
+  // how far the registers have shifted since.
+  // px[0 - 7] are the current tile's pixels, and px[8 - 15] the next tile's.
+  // Mid-tile register writes get the queue re-decoded from that dot on.
+  // Newly loaded tiles are taken straight from the decoded CHR cache (see
+  // bgr_fetch), instead of being picked back out of the bitplanes.
+  struct {
+    Pixel px [16];
+    uint  shifts;      // since px was decoded
+    uint  reloads;     // times the shift registers got a new tile since then
+    uint  reloaded_at; // (value of shifts at the last reload)
+    bool  stale;       // a register write might've changed things (palettes)
+
+    u8   pal [32]; // palette RAM, as seen by the per-dot renderer
+    bool pal_stale;
+
+    u8   fetched [8];  // decoded row of the tile being fetched
+    u16  fetched_addr; // (its pattern table address, 0xFFFF once checked)
+    uint fetched_generation;
+    bool fetched_ok;   // ...matches the bitplanes that were actually fetched
+    u8   loaded [8];   // decoded row of the tile last loaded into the shifters
+    bool loaded_ok;
+  } bgr_queue;
+
+  void bgr_queue_clear_rows() {
+    this->bgr_queue.fetched_addr = 0xFFFF;
+    this->bgr_queue.fetched_ok = false;
+    this->bgr_queue.loaded_ok = false;
+  }
+
+  bool bgr_queue_outdated() const {
+    return this->bgr_queue.stale
+        || this->bgr_queue.reloads
+        || this->bgr_queue.shifts + this->reg.x >= 16;
+  }
+  void bgr_queue_update();
+  void bgr_queue_decode(uint first, const u8* row = nullptr);
+
+  // Could a sprite zero hit still happen on this line?
+  bool spr_zero_pending() const {
+    return this->spr.spr_zero_on_line && this->reg.ppustatus.S == 0;
+  }
+
+  // Frame skipping
+  // When set, the PPU only does the work that has side effects visible to the
+  // CPU / cart (fetches, sprite evaluation, sprite zero hits), without drawing
+  // anything to the framebuffers.
+  // Requests are latched at the start of the pre-render line, since the lazy
+  // PPU may already be a few dots into the next frame by the time
+  // NES::step_frame returns.
+  bool skip_render;
+  bool skip_render_next; // requested
+
   void bgr_fetch();
   void spr_fetch();
 
-  /*----  Emulation Vars and Methods  ----*/
+  // Will the PPU read OAM within the next `cycles` cycles?
+  bool reads_oam_within(uint cycles) const;
 
-  // RGBA framebuffers - easily passed to rendering layer
-  u8 framebuffer     [256 * 4 * 240] = {0};
-  u8 framebuffer_spr [256 * 4 * 240] = {0};
-  u8 framebuffer_bgr [256 * 4 * 240] = {0};
+  // Fast path for drawing a whole visible scanline at once
+  bool can_render_scanline() const;
+  void render_scanline();
+
+  struct SprLinePixel {
+    u8   nes_color;
+    bool is_on;
+    bool priority;
+    bool is_zero; // pixel belongs to sprite 0
+  };
+  void draw_spr_line(SprLinePixel* spr_line, const u8* pal, uint from_x);
+
+  // Sprite line buffer
+  // Drawn once per scanline (after sprite evaluation), and redrawn from the
+  // current dot onwards whenever something it depends on changes mid-line
+  // (i.e: register / palette writes, and CHR bank switches).
+  SprLinePixel spr_line [256];
+  bool spr_line_stale;
+  uint spr_line_chr_generation;
+
+  /*----  Emulation Vars and Methods  ----*/
 
   // nes color framebuffers
-  u8 framebuffer_nes_color     [256 * 240] = {0};
-  u8 framebuffer_nes_color_bgr [256 * 240] = {0};
-  u8 framebuffer_nes_color_spr [256 * 240] = {0};
+  // Only the composite framebuffer is always drawn. The background-only and
+  // sprite-only layers are allocated (and drawn) while someone subscribes to
+  // them (see subscribeLayers), and are null otherwise.
+  u8  framebuffer_nes_color [256 * 240] = {0};
+  u8  framebuffer_emphasis  [240] = {0}; // PPUMASK emphasis bits, per line
+  u8* framebuffer_nes_color_bgr;
+  u8* framebuffer_nes_color_spr;
+  uint layer_subscribers [2];
 
+  // RGBA framebuffers - easily passed to rendering layer
+  // Converted from the nes color framebuffers in one go, whenever they are
+  // asked for (and have changed since the last time they were asked for).
+  static const ARGBConverter argb;
+  mutable u8*  framebuffer;
+  mutable u8*  framebuffer_bgr;
+  mutable u8*  framebuffer_spr;
+  mutable uint framebuffer_stale; // bitmask: 1 = composite, 2 = bgr, 4 = spr
 
   // scanline tracker
   struct {
@@ -221,7 +312,22 @@ private:
   uint cycles; // total PPU cycles
   uint frames; // total frames rendered
 
-  SERIALIZE_START(9, "PPU")
+  // Lazy catch-up
+  // The PPU is allowed to fall behind the CPU, and only catches up once the
+  // CPU is about to observe it (i.e: touches PPU / mapper registers), or once
+  // something the CPU could observe is about to happen (see PPU::run).
+  uint lag;     // cycles the PPU has fallen behind by
+  uint sync_in; // lag at which the PPU has to catch up
+
+  // Overclocking
+  // Games that run out of CPU time before vblank lag (e.g: Gradius, Kirby).
+  // With extra_lines set, the PPU sits idle for that many extra lines after the
+  // post-render line, pushing back vblank / NMI. The CPU keeps running, but
+  // the PPU and APU don't see the extra time (see NES::cycle).
+  const uint& extra_lines;
+  uint overclock_dots; // idle cycles left in the current extra lines
+
+  SERIALIZE_START(12, "PPU")
     SERIALIZE_SERIALIZABLE(oam)
     SERIALIZE_SERIALIZABLE(oam2)
     SERIALIZE_POD(spr)
@@ -231,7 +337,24 @@ private:
     SERIALIZE_POD(scan)
     SERIALIZE_POD(cycles)
     SERIALIZE_POD(frames)
-  SERIALIZE_END(9)
+    SERIALIZE_POD(lag)
+    SERIALIZE_POD(sync_in)
+    SERIALIZE_POD(overclock_dots)
+  SERIALIZE_END(12)
+
+  virtual const Serializable::Chunk* deserialize(const Serializable::Chunk* c) override {
+    c = this->Serializable::deserialize(c);
+    this->spr_line_stale = true;
+    this->bgr_queue.stale = true;
+    this->bgr_queue.pal_stale = true;
+    this->bgr_queue_clear_rows();
+    return c;
+  }
+
+  // Cycles until the next cycle that could change PPUSTATUS, fire an NMI, or
+  // finish a frame (relative to where the PPU is, not the CPU). Might be too
+  // early, but never too late.
+  uint cycles_until_sync() const;
 
   /*---------------  Hacks  --------------*/
 
@@ -247,10 +370,15 @@ private:
 public:
   PPU() = delete;
   PPU(const NES_Params& params,
-    Memory& mem,
+    PPU_MMU& mem,
     DMA& dma,
     InterruptLines& interrupts
   );
+  ~PPU();
+
+  // (owns the per-layer framebuffers)
+  PPU(const PPU&) = delete;
+  PPU& operator=(const PPU&) = delete;
 
   // <Memory>
   u8 read(u16 addr) override;
@@ -263,16 +391,71 @@ public:
 
   void cycle();
 
+  // Run for some number of cycles... eventually (see lag)
+  void run(uint cycles);
+  // Catch up with the CPU
+  void sync();
+  uint getLag() const { return this->lag; }
+
+  // Cycles left in the current extra lines, as far as the CPU is concerned
+  // (see extra_lines)
+  uint overclock_left() const {
+    return this->overclock_dots > this->lag ? this->overclock_dots - this->lag : 0;
+  }
+
+  // Number of cycles until the next cycle that the CPU could notice, without
+  // accessing PPU registers (i.e: NMIs and frame ends, and the start / end of
+  // any extra lines). Might be too early.
+  uint cycles_until_event() const;
+
+  // Number of cycles until the n'th rising edge of A12 caused by rendering
+  // fetches (i.e: what clocks MMC3 style scanline counters), counted from
+  // where the PPU is (i.e: regardless of lag). Might be too early.
+  // Returns 0 when it can't be predicted, and UINT_MAX while rendering is off.
+  uint cycles_until_a12_rises(uint n) const;
+
+  struct SyncStats {
+    u64 syncs;      // catch-ups
+    u64 cycles;     // cycles run while catching up
+    u64 fast_lines; // scanlines drawn by the scanline renderer
+  };
+
+  const SyncStats& getSyncStats() const { return this->sync_stats; }
+  void resetSyncStats() { this->sync_stats = SyncStats(); }
+
+private:
+  SyncStats sync_stats;
+
+public:
+
+  // Optional framebuffer layers, which consumers have to subscribe to
+  enum Layer : uint {
+    LAYER_BGR = 1 << 0, // background only
+    LAYER_SPR = 1 << 1, // sprites only
+  };
+
+  void subscribeLayers  (uint layers);
+  void unsubscribeLayers(uint layers);
+
+  // The Bgr / Spr framebuffers are null unless subscribed to
   void getFramebuffSpr(const u8** framebuffer) const;
   void getFramebuffBgr(const u8** framebuffer) const;
   void getFramebuff   (const u8** framebuffer) const;
 
+  // Converts the current frame straight into a caller-provided 256 x 240
+  // ARGB8888 buffer (e.g: a locked texture), `pitch` bytes apart per line
+  void copyFramebuff(u8* argb, uint pitch) const;
+
   void getFramebuffNESColorSpr(const u8** framebuffer) const;
   void getFramebuffNESColorBgr(const u8** framebuffer) const;
   void getFramebuffNESColor   (const u8** framebuffer) const;
 
   uint getNumFrames() const;
 
+  // Frames run while set are not drawn (see skip_render)
+  // Takes effect from the *next* frame onwards
+  void skipRender(bool skip) { this->skip_render_next = skip; }
+
   // NES color palette (static, for the time being)
   static const Color palette [64];
 
@@ -285,6 +468,14 @@ public:
   const Memory&    _mem()       const { return this->mem;        }
   const Registers& _reg()       const { return this->reg;        }
 
+  // A register write, as recorded for the line_writes callback
+  struct RegWrite {
+    u16 addr;
+    u8  val;
+    u16 line;
+    u16 dot;
+  };
+
   struct {
     CallbackManager<> cycle_start;
     CallbackManager<> cycle_end;
@@ -295,5 +486,33 @@ public:
     CallbackManager<u16, u8> read_end;
     CallbackManager<u16, u8> write_start;
     CallbackManager<u16, u8> write_end;
+    // All the register writes made during a line, delivered at the end of it
+    // (or earlier, if there's a _lot_ of them)
+    CallbackManager<const RegWrite*, uint> line_writes;
   } _callbacks;
+
+private:
+  // Which of the _callbacks have subscribers, so that unused instrumentation
+  // only costs a single branch (and the scanline renderer stays usable)
+  enum Hook : uint {
+    HOOK_CYCLE_START = 1 << 0,
+    HOOK_CYCLE_END   = 1 << 1,
+    HOOK_SCANLINE    = 1 << 2,
+    HOOK_FRAME_START = 1 << 3,
+    HOOK_FRAME_END   = 1 << 4,
+    HOOK_READ_START  = 1 << 5,
+    HOOK_READ_END    = 1 << 6,
+    HOOK_WRITE_START = 1 << 7,
+    HOOK_WRITE_END   = 1 << 8,
+    HOOK_LINE_WRITES = 1 << 9,
+  };
+  uint hooks;
+
+  // Register writes made during the current line (see line_writes)
+  struct {
+    RegWrite writes [64];
+    uint len;
+  } write_log;
+
+  void flush_write_log();
 };
@@ -0,0 +1,34 @@
+#include "chr_cache.h"
+
+#include <cstring>
+
+void ChrPage::decode(uint tile) {
+  this->dirty &= ~(u64(1) << tile);
+
+  if (!this->mem) {
+    memset(&this->tiles[tile], 0, sizeof this->tiles[tile]);
+    return;
+  }
+
+  for (uint row = 0; row < 8; row++) {
+    const u16 addr = this->offset + tile * 16 + row;
+    const u8 lo_bp = this->mem->peek(addr + 0);
+    const u8 hi_bp = this->mem->peek(addr + 8);
+
+    for (uint col = 0; col < 8; col++) {
+      const u8 pixel_type = nth_bit(lo_bp, 7 - col)
+                          + (nth_bit(hi_bp, 7 - col) << 1);
+      this->tiles[tile].px[0][row][col]     = pixel_type;
+      this->tiles[tile].px[1][row][7 - col] = pixel_type;
+    }
+  }
+}
+
+void ChrTable::clear() {
+  this->blank.mem = nullptr;
+  this->blank.offset = 0;
+  this->blank.dirty = ~u64(0);
+
+  for (uint i = 0; i < 8; i++)
+    this->map(i * 0x400, &this->blank);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common/util.h"
+#include "nes/interfaces/memory.h"
+
+// Decoded CHR Tile Cache
+// Pattern tiles are stored as two separate bitplanes, so working out a single
+// pixel means reading a byte from each plane (through the PPU_MMU, the Mapper,
+// and the CHR bank), and picking a bit out of each.
+//
+// Instead, each 1K page of CHR memory (64 tiles) gets decoded once into plain
+// 2-bit pixel indices (plus a horizontally flipped copy), and the cartridge
+// publishes which decoded page is mapped into each 1K of pattern table space
+// (much like the CPU's PageTable), so a row of 8 pixels is a single lookup.
+//
+// Tiles are decoded lazily, and get re-decoded after being written to (i.e:
+// CHR RAM).
+
+struct DecodedTile {
+  u8 px [2][8][8]; // [flipped horizontally][row][col] -> 2-bit pixel index
+};
+
+struct ChrPage {
+  const Memory* mem;    // CHR bank this page belongs to
+  u16           offset; // offset of this page within the bank
+  u64           dirty;  // tiles that have to be (re)decoded (1 bit per tile)
+
+  DecodedTile tiles [64];
+
+  void decode(uint tile);
+};
+
+struct ChrTable {
+  ChrPage* pages [8]; // 1K pages mapped into PPU 0x0000 ... 0x1FFF
+  ChrPage  blank;     // (unmapped pattern table space reads as all zeros)
+  uint generation;    // bumped whenever the mapping changes
+
+  ChrTable() : pages(), blank(), generation(0) { this->clear(); }
+
+  // pages might point at this table's own blank page
+  ChrTable(const ChrTable&) = delete;
+  ChrTable& operator=(const ChrTable&) = delete;
+
+  // Points every page at a blank (all transparent) page
+  void clear();
+
+  void map(u16 addr, ChrPage* page) {
+    if (this->pages[addr >> 10] == page) return;
+    this->pages[addr >> 10] = page;
+    this->generation++;
+  }
+
+  void invalidate(u16 addr) {
+    this->pages[(addr >> 10) & 7]->dirty |= u64(1) << ((addr & 0x3FF) >> 4);
+  }
+
+  // Returns 8 pixels of the tile-row at pattern table address `addr`
+  // (i.e: the address of the row's low bitplane byte)
+  const u8* row(u16 addr, bool flip) const {
+    ChrPage* page = this->pages[(addr >> 10) & 7];
+    const uint tile = (addr & 0x3FF) >> 4;
+    if (page->dirty & (u64(1) << tile)) page->decode(tile);
+    return page->tiles[tile].px[flip][addr & 7];
+  }
+};
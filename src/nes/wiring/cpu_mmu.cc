@@ -1,11 +1,13 @@
 #include "cpu_mmu.h"
 
+#include "nes/ppu/ppu.h"
+
 #include <cassert>
 #include <cstdio>
 
 CPU_MMU::CPU_MMU(
-  Memory& ram,
-  Memory& ppu,
+  RAM&    ram,
+  PPU&    ppu,
   Memory& apu,
   Memory& joy
 )
@@ -15,6 +17,10 @@ CPU_MMU::CPU_MMU(
   joy(joy)
 {
   this->cart = nullptr;
+
+  // WRAM is mirrored 4x
+  for (u16 addr = 0x0000; addr < 0x2000; addr += 0x800)
+    this->pages.map(addr, 0x800, this->ram.data(), this->ram.data());
 }
 
 // 0x0000 ... 0x1FFF: 0x0000 - 0x07FF are RAM           (Mirrored 4x)
@@ -32,7 +38,7 @@ CPU_MMU::CPU_MMU(
 #define ADDR1(lo    ) if (in_range(addr, lo    ))
 #define ADDR2(lo, hi) if (in_range(addr, lo, hi))
 
-u8 CPU_MMU::read(u16 addr) {
+u8 CPU_MMU::read_io(u16 addr) {
   ADDR(0x0000, 0x1FFF) return this->ram.read(addr % 0x800);
   ADDR(0x2000, 0x3FFF) return this->ppu.read(addr % 8 + 0x2000);
   ADDR(0x4000, 0x4013) return this->apu.read(addr);
@@ -49,7 +55,7 @@ u8 CPU_MMU::read(u16 addr) {
 }
 
 // unfortunately, I have to duplicate this map for peek
-u8 CPU_MMU::peek(u16 addr) const {
+u8 CPU_MMU::peek_io(u16 addr) const {
   ADDR(0x0000, 0x1FFF) return this->ram.peek(addr % 0x800);
   ADDR(0x2000, 0x3FFF) return this->ppu.peek(addr % 8 + 0x2000);
   ADDR(0x4000, 0x4013) return this->apu.peek(addr);
@@ -65,7 +71,7 @@ u8 CPU_MMU::peek(u16 addr) const {
   return 0;
 }
 
-void CPU_MMU::write(u16 addr, u8 val) {
+void CPU_MMU::write_io(u16 addr, u8 val) {
   // Some test roms provide test status info in addr 0x6000, and write c-style
   // null-terminated ascii strings starting at 0x6004
   // They signal this behavior by writing 0xDEB061 to 0x6001 - 0x6003
@@ -91,11 +97,27 @@ void CPU_MMU::write(u16 addr, u8 val) {
   ADDR(0x4016        ) return this->joy.write(addr, val);
   ADDR(0x4017        ) return this->apu.write(addr, val); // not JOY
   ADDR(0x4018, 0x401F) return; // ?
-  ADDR(0x4020, 0xFFFF) return this->cart ? this->cart->write(addr, val) : void();
+  ADDR(0x4020, 0xFFFF) {
+    // mapper registers can switch CHR banks / mirroring under the PPU's feet
+    this->ppu.sync();
+    return this->cart ? this->cart->write(addr, val) : void();
+  }
 
   fprintf(stderr, "[CPU] unhandled address: 0x%04X\n", addr);
   assert(false);
 }
 
-void CPU_MMU::loadCartridge(Mapper* cart) { this->cart = cart;    }
-void CPU_MMU::removeCartridge()           { this->cart = nullptr; }
+void CPU_MMU::loadCartridge(Mapper* cart) {
+  this->removeCartridge();
+
+  this->cart = cart;
+  this->cart->set_cpu_pages(&this->pages);
+}
+
+void CPU_MMU::removeCartridge() {
+  if (this->cart)
+    this->cart->set_cpu_pages(nullptr);
+  this->cart = nullptr;
+
+  this->pages.unmap(0x4000, 0xC000);
+}
@@ -3,6 +3,11 @@
 #include "common/util.h"
 #include "nes/cartridge/mapper.h"
 #include "nes/interfaces/memory.h"
+#include "nes/generic/ram/ram.h"
+
+#include "page_table.h"
+
+class PPU;
 
 // CPU Memory Map (MMU)
 // NESdoc.pdf
@@ -11,28 +16,64 @@
 class CPU_MMU final : public Memory {
 private:
   // Fixed References (these will never be invalidated)
-  Memory& ram;
-  Memory& ppu;
+  RAM&    ram;
+  PPU&    ppu;
   Memory& apu;
   Memory& joy;
 
   // Changing References
   Mapper* cart;
+
+  // Direct mappings for side-effect free memory (WRAM, PRG ROM / RAM)
+  // Pages that aren't mapped go through the full address decoder.
+  PageTable pages;
+
+  u8 read_io(u16 addr);
+  u8 peek_io(u16 addr) const;
+  void write_io(u16 addr, u8 val);
+
 public:
   CPU_MMU() = delete;
   CPU_MMU(
-    Memory& ram,
-    Memory& ppu,
+    RAM&    ram,
+    PPU&    ppu,
     Memory& apu,
     Memory& joy
   );
 
   // <Memory>
-  u8 read(u16 addr)       override;
-  u8 peek(u16 addr) const override;
-  void write(u16 addr, u8 val) override;
+  // These are defined inline, since the CPU hits them on every single access
+  u8 read(u16 addr) override {
+    if (const u8* page = this->pages.read[addr >> 8])
+      return page[addr & 0xFF];
+    return this->read_io(addr);
+  }
+  u8 peek(u16 addr) const override {
+    if (const u8* page = this->pages.read[addr >> 8])
+      return page[addr & 0xFF];
+    return this->peek_io(addr);
+  }
+  void write(u16 addr, u8 val) override {
+    // Test-rom status text at 0x6000 - 0x61FF is always routed through write_io
+    u8* page = this->pages.write[addr >> 8];
+    if (page && (addr & 0xFE00) != 0x6000) {
+      page[addr & 0xFF] = val;
+      return;
+    }
+    this->write_io(addr, val);
+  }
   // <Memory/>
 
+  const PageTable& page_table() const { return this->pages; }
+
+  // Whether an access would take the fast-path (i.e: has no side-effects)
+  bool is_direct_read(u16 addr) const {
+    return this->pages.read[addr >> 8] != nullptr;
+  }
+  bool is_direct_write(u16 addr) const {
+    return this->pages.write[addr >> 8] != nullptr && (addr & 0xFE00) != 0x6000;
+  }
+
   void loadCartridge(Mapper* cart);
   void removeCartridge();
 };
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common/util.h"
+
+// CPU Page Table
+// Maps each 256 byte page of the CPU address space directly onto it's backing
+// memory, so that accesses to plain memory (WRAM, PRG ROM, PRG RAM) can skip
+// the CPU_MMU's address decoding entirely, and become a single indexed load.
+//
+// nullptr entries denote "I/O pages" (registers, open-bus, memory with
+// side-effects, etc...), which have to go through the regular Memory interface.
+struct PageTable {
+  const u8* read  [256];
+        u8* write [256];
+  bool      is_rom[256]; // contents of page can never change (i.e: PRG ROM)
+
+  PageTable() { this->clear(); }
+
+  void clear() { this->unmap(0x0000, 0x10000); }
+
+  // Map `len` bytes of CPU address space starting at `addr` onto `rd` / `wr`
+  // (either of which may be nullptr, leaving that direction as I/O)
+  // `addr` and `len` must both be multiples of the page size.
+  void map(u16 addr, uint len, const u8* rd, u8* wr, bool is_rom = false) {
+    for (uint i = 0; i < len / 0x100; i++) {
+      this->read  [(addr >> 8) + i] = rd ? rd + i * 0x100 : nullptr;
+      this->write [(addr >> 8) + i] = wr ? wr + i * 0x100 : nullptr;
+      this->is_rom[(addr >> 8) + i] = is_rom;
+    }
+  }
+
+  void unmap(u16 addr, uint len) { this->map(addr, len, nullptr, nullptr); }
+
+  // Copy `len` bytes worth of mappings starting at `addr` from another table
+  void copy(const PageTable& other, u16 addr, uint len) {
+    for (uint i = 0; i < len / 0x100; i++) {
+      this->read  [(addr >> 8) + i] = other.read  [(addr >> 8) + i];
+      this->write [(addr >> 8) + i] = other.write [(addr >> 8) + i];
+      this->is_rom[(addr >> 8) + i] = other.is_rom[(addr >> 8) + i];
+    }
+  }
+};
@@ -5,12 +5,16 @@
 #include <cstring>
 
 PPU_MMU::PPU_MMU(
-  Memory& ciram,
+  RAM& ciram,
   Memory& pram
 )
 : ciram(ciram),
-  pram(pram)
-{ this->set_mirroring(); }
+  pram(pram),
+  mirroring(Mirroring::Type::INVALID)
+{
+  for (uint i = 0; i < 4; i++)
+    this->nt[i] = this->ciram.data();
+}
 
 // 0x0000 ... 0x1FFF: Pattern Tables
 // 0x2000 ... 0x23FF: Nametable 0
@@ -32,23 +36,19 @@ inline u16 pram_mirror(u16 addr) {
   return addr;
 }
 
-inline u16 PPU_MMU::nt_mirror(u16 addr) const {
-  // When using FourScreen mirroring, the 0x2000 offset that is usually stripped
-  // from the address to access ciram must be restored, since accessing the cart
-  // from 0x0000 to 0x0FFF is CHR Memory, while the extra cart ram is located
-  // from 0x2000 to 0x2FFF!
-  const u16 fix_4s = 0x2000 * (this->mirroring == Mirroring::Type::FourScreen);
-
-  return this->nt[(addr - 0x2000) / 0x400] * 0x400 + (addr % 0x400) + fix_4s;
-}
-
 #define ADDR(lo, hi) if (in_range(addr, lo, hi))
 
 u8 PPU_MMU::read(u16 addr) {
-  this->set_mirroring();
-
-  ADDR(0x0000, 0x1FFF) return this->cart ? this->cart->read(addr) : 0x00;
-  ADDR(0x2000, 0x2FFF) return this->vram->read(this->nt_mirror(addr));
+  ADDR(0x0000, 0x1FFF) {
+    if (this->watch_a12) {
+      const bool a12 = nth_bit(addr, 12);
+      if (this->last_a12 == 0 && a12 == 1) // Rising Edge
+        this->cart->ppu_a12_rise();
+      this->last_a12 = a12;
+    }
+    return this->cart ? this->cart->read(addr) : 0x00;
+  }
+  ADDR(0x2000, 0x2FFF) return this->nt[(addr >> 10) & 3][addr & 0x3FF];
   ADDR(0x3000, 0x3EFF) return this->read(addr - 0x1000);
   ADDR(0x3F00, 0x3FFF) return this->pram.read(pram_mirror(addr));
   ADDR(0x4000, 0xFFFF) return this->read(addr - 0x4000);
@@ -60,7 +60,7 @@ u8 PPU_MMU::read(u16 addr) {
 
 u8 PPU_MMU::peek(u16 addr) const {
   ADDR(0x0000, 0x1FFF) return this->cart ? this->cart->peek(addr) : 0x00;
-  ADDR(0x2000, 0x2FFF) return this->vram->peek(this->nt_mirror(addr));
+  ADDR(0x2000, 0x2FFF) return this->nt[(addr >> 10) & 3][addr & 0x3FF];
   ADDR(0x3000, 0x3EFF) return this->peek(addr - 0x1000);
   ADDR(0x3F00, 0x3FFF) return this->pram.peek(pram_mirror(addr));
   ADDR(0x4000, 0xFFFF) return this->peek(addr - 0x4000);
@@ -71,10 +71,16 @@ u8 PPU_MMU::peek(u16 addr) const {
 }
 
 void PPU_MMU::write(u16 addr, u8 val) {
-  this->set_mirroring();
-
-  ADDR(0x0000, 0x1FFF) return this->cart ? this->cart->write(addr, val) : void();
-  ADDR(0x2000, 0x2FFF) return this->vram->write(this->nt_mirror(addr), val);
+  ADDR(0x0000, 0x1FFF) {
+    if (!this->cart) return;
+    this->cart->write(addr, val);
+    this->cart->chr_written(addr);
+    return;
+  }
+  ADDR(0x2000, 0x2FFF) {
+    this->nt[(addr >> 10) & 3][addr & 0x3FF] = val;
+    return;
+  }
   ADDR(0x3000, 0x3EFF) return this->write(addr - 0x1000, val);
   ADDR(0x3F00, 0x3FFF) return this->pram.write(pram_mirror(addr), val);
   ADDR(0x4000, 0xFFFF) return this->write(addr - 0x4000, val);
@@ -83,7 +89,7 @@ void PPU_MMU::write(u16 addr, u8 val) {
   assert(false);
 }
 
-void PPU_MMU::set_mirroring() {
+void PPU_MMU::set_mirroring(Mirroring::Type mirroring) {
   static constexpr uint nt_mirroring [5][4] = {
     /* Vertical       */ { 0, 1, 0, 1 },
     /* Horizontal     */ { 0, 0, 1, 1 },
@@ -92,38 +98,60 @@ void PPU_MMU::set_mirroring() {
     /* SingleScreenHi */ { 1, 1, 1, 1 }
   };
 
-  if (this->cart == nullptr) {
-    this->mirroring = Mirroring::Type::INVALID;
-    this->vram = &this->ciram;
-    this->nt = nt_mirroring[Mirroring::Type::SingleScreenLo]; // y not
-    return;
-  }
-
-  Mirroring::Type old_mirroring = this->mirroring;
-  this->mirroring = this->cart->mirroring();
-  assert(this->mirroring != Mirroring::Type::INVALID);
-  if (old_mirroring == this->mirroring) return;
+  if (this->mirroring == mirroring) return;
 
   // Change mirroring mode!
 
-  fprintf(stderr,
-    "[PPU_MMU] Mirroring: %s -> %s\n",
-    Mirroring::toString(old_mirroring),
-    Mirroring::toString(this->mirroring)
-  );
+  if (mirroring != Mirroring::Type::INVALID) {
+    fprintf(stderr,
+      "[PPU_MMU] Mirroring: %s -> %s\n",
+      Mirroring::toString(this->mirroring),
+      Mirroring::toString(mirroring)
+    );
+  }
+
+  this->mirroring = mirroring;
+
+  u8* vram = this->ciram.data();
+  const uint* nt = nt_mirroring[Mirroring::Type::SingleScreenLo]; // y not
+
+  if (mirroring == Mirroring::Type::FourScreen) {
+    // Unlikely, but some games do this (Rad Racer II)
+    vram = this->cart ? this->cart->four_screen_vram() : nullptr;
+    nt = nt_mirroring[mirroring];
+
+    if (!vram) {
+      // The mapper doesn't provide the extra 2K of VRAM, so make do with
+      // CIRAM ({ 0, 1, 2, 3 } wrapped around to 2K is just Vertical)
+      fprintf(stderr, "[PPU_MMU] No four-screen VRAM on cart! Using CIRAM\n");
+      vram = this->ciram.data();
+      nt = nt_mirroring[Mirroring::Type::Vertical];
+    }
+  } else if (mirroring != Mirroring::Type::INVALID) {
+    nt = nt_mirroring[mirroring];
+  }
 
-  this->nt = nt_mirroring[this->mirroring];
-  this->vram = (this->mirroring == Mirroring::Type::FourScreen)
-    ? this->cart // Unlikely, but some games do this (Rad Racer II)
-    : &this->ciram;
+  for (uint i = 0; i < 4; i++)
+    this->nt[i] = vram + nt[i] * 0x400;
+}
+
+void PPU_MMU::power_cycle() {
+  this->last_a12 = false;
 }
 
 void PPU_MMU::loadCartridge(Mapper* cart) {
+  this->removeCartridge();
+
   this->cart = cart;
-  this->set_mirroring();
+  this->watch_a12 = cart->timing() & Mapper::Timing::PPU_A12;
+  this->last_a12 = false;
+  this->cart->set_ppu_mmu(this);
 }
 
 void PPU_MMU::removeCartridge() {
+  if (this->cart)
+    this->cart->set_ppu_mmu(nullptr);
   this->cart = nullptr;
-  this->set_mirroring();
+  this->watch_a12 = false;
+  this->set_mirroring(Mirroring::Type::INVALID);
 }
@@ -2,6 +2,7 @@
 
 #include "common/util.h"
 #include "nes/cartridge/mapper.h"
+#include "nes/generic/ram/ram.h"
 #include "nes/interfaces/memory.h"
 
 // PPU Memory Map (MMU)
@@ -10,27 +11,27 @@
 class PPU_MMU final : public Memory {
 private:
   // Fixed References (these will never be invalidated)
-  Memory& ciram; // PPU internal VRAM
+  RAM&    ciram; // PPU internal VRAM
   Memory& pram;  // Palette RAM
 
   // Changing References
   Mapper* cart = nullptr; // Plugged in cartridge
 
-  // VRAM is usually == &ciram, but it == cart when FourScreen mirroring
-  Memory* vram;
+  // A12 edge detection, only done when the cart asks for it (see Mapper::Timing)
+  bool watch_a12 = false;
+  bool last_a12  = false; // bit 12 of last CHR Memory read
 
-  // Nametable offsets + Mirror mode
-  Mirroring::Type mirroring;
-  const uint* nt; // pointer to array of  offsets for current nt mirroring
-
-  u16 nt_mirror(u16 addr) const; // helper for doing nametable address routing
+  ChrTable no_chr; // blank pattern tables, for when there is no cart
 
-  void set_mirroring();
+  // Mirror mode + the 1K of VRAM each nametable is currently mapped to.
+  // VRAM is usually ciram, but it's on the cart when using FourScreen mirroring
+  Mirroring::Type mirroring;
+  u8* nt [4];
 
 public:
   PPU_MMU() = delete;
   PPU_MMU(
-    Memory& ciram,
+    RAM& ciram,
     Memory& pram
   );
 
@@ -40,6 +41,20 @@ public:
   void write(u16 addr, u8 val) override;
   // <Memory/>
 
+  void power_cycle();
+
+  // Decoded pattern tiles (see nes/wiring/chr_cache.h)
+  const ChrTable& chr_tiles() const {
+    return this->cart ? this->cart->chr_tiles() : this->no_chr;
+  }
+
+  // Level of PPU A12 as of the last CHR read (only tracked for carts that ask
+  // for A12 edges)
+  bool a12() const { return this->last_a12; }
+
+  // Called by the cart whenever it's mirroring mode might have changed
+  void set_mirroring(Mirroring::Type mirroring);
+
   void loadCartridge(Mapper* cart);
   void removeCartridge();
 };
@@ -15,7 +15,11 @@ void Config::load(int argc, char* argv[]) {
     = clara::Help(show_help)
     | clara::Opt(this->cli.log_cpu)
         ["--log-cpu"]
-        ("Output CPU execution over STDOUT")
+        ("Record a trace of CPU execution \n"
+         "(dumped to <rom>.trace when toggled off with Ctrl+C, or on crash)")
+    | clara::Opt(this->cli.decode_trace_path, "path")
+        ["--decode-trace"]
+        ("Print a dumped CPU trace in the nestest log format, and exit")
     | clara::Opt(this->cli.no_sav)
         ["--no-sav"]
         ("Don't load/create sav/savestate files")
@@ -23,6 +27,23 @@ void Config::load(int argc, char* argv[]) {
         ["--alt-nmi-timing"]
         ("Enable NMI timing fix \n"
          "(fixes some games, eg: Bad Dudes, Solomon's Key)")
+    | clara::Opt(this->cli.overclock_lines, "lines")
+        ["--overclock"]
+        ("Give games more CPU time per frame, by adding idle PPU scanlines \n"
+         "(fixes slowdown in some games, eg: Gradius, Kirby)")
+    | clara::Opt(this->cli.apu_oversample, "factor")
+        ["--apu-oversample"]
+        ("Synthesize audio at some multiple of the output sample rate \n"
+         "(and filter it back down, for less aliasing)")
+    | clara::Opt(this->cli.audio_latency, "ms")
+        ["--audio-latency"]
+        ("How much audio to keep queued up (default: 32ms)")
+    | clara::Opt(this->cli.dynarec)
+        ["--dynarec"]
+        ("Run hot game code through the (x86-64) dynamic recompiler")
+    | clara::Opt(this->cli.bench_frames, "frames")
+        ["--bench"]
+        ("Run the rom headless for some number of frames, and print the FPS")
     | clara::Opt(this->cli.record_fm2_path, "path")
         ["--record-fm2"]
         ("Record a movie in the fm2 format")
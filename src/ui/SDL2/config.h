@@ -28,6 +28,11 @@ public:
     bool log_cpu = false;
     bool no_sav  = false;
     bool ppu_timing_hack = false;
+    uint overclock_lines = 0;
+    uint apu_oversample = 1;
+    uint audio_latency = 32;
+    bool dynarec = false;
+    uint bench_frames = 0;
 
     bool ppu_debug = false;
     bool widenes = false;
@@ -37,6 +42,8 @@ public:
 
     std::string config_file;
 
+    std::string decode_trace_path;
+
     std::string rom;
   } cli;
 };
@@ -0,0 +1,77 @@
+#include "trace.h"
+
+#include "load.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Trace dumps are just a small header, followed by the raw records.
+// (records are written with the host's endianness / padding, so dumps are
+//  meant to be decoded on the same machine / build that created them)
+struct TraceHeader {
+  char magic [8];
+  u32  record_size;
+  u32  len;
+};
+
+static const char TRACE_MAGIC [8] = { 'A','N','E','S','E','T','R','C' };
+
+bool ANESE_fs::trace::dump_cpu_trace(const char* filepath, const CPUTrace& trace) {
+  FILE* trace_file = fopen(filepath, "wb");
+  if (!trace_file) {
+    fprintf(stderr, "[Trace][Dump] Failed to open '%s'!\n", filepath);
+    return false;
+  }
+
+  TraceHeader header;
+  memcpy(header.magic, TRACE_MAGIC, sizeof header.magic);
+  header.record_size = sizeof(CPUTrace::Record);
+  header.len = trace.size();
+
+  fwrite(&header, sizeof header, 1, trace_file);
+  for (uint i = 0; i < trace.size(); i++)
+    fwrite(&trace[i], sizeof trace[i], 1, trace_file);
+
+  fclose(trace_file);
+  fprintf(stderr, "[Trace][Dump] Dumped %u instructions to '%s'\n",
+    trace.size(), filepath);
+
+  return true;
+}
+
+bool ANESE_fs::trace::decode_cpu_trace(const char* filepath) {
+  u8* data = nullptr;
+  uint data_len = 0;
+  if (!ANESE_fs::load::load_file(filepath, data, data_len))
+    return false;
+
+  TraceHeader header;
+  memset(&header, 0, sizeof header);
+  if (data_len >= sizeof header)
+    memcpy(&header, data, sizeof header);
+
+  const bool valid = memcmp(header.magic, TRACE_MAGIC, sizeof header.magic) == 0
+    && header.record_size == sizeof(CPUTrace::Record)
+    && data_len >= sizeof header + header.len * sizeof(CPUTrace::Record);
+
+  if (!valid) {
+    fprintf(stderr, "[Trace][Decode] '%s' is not a valid CPU trace!\n", filepath);
+    delete[] data;
+    return false;
+  }
+
+  const u8* records = data + sizeof header;
+  for (uint i = 0; i < header.len; i++) {
+    CPUTrace::Record record;
+    memcpy(&record, records + i * sizeof record, sizeof record);
+
+    char line [CPUTrace::FORMAT_LEN];
+    CPUTrace::format(record, line);
+    printf("%s SL:%d\n", line,
+      record.scanline == 261 ? -1 : record.scanline // pre-render line is -1
+    );
+  }
+
+  delete[] data;
+  return true;
+}
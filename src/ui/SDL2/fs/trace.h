@@ -0,0 +1,12 @@
+#pragma once
+
+#include "nes/cpu/trace.h"
+
+namespace ANESE_fs { namespace trace {
+
+  // Writes out all the records in a CPU trace (oldest first)
+  bool dump_cpu_trace(const char* filepath, const CPUTrace& trace);
+  // Prints a dumped CPU trace to stdout as nestest-style text
+  bool decode_cpu_trace(const char* filepath);
+
+}}
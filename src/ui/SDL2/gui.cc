@@ -1,9 +1,14 @@
 #include "gui.h"
 
 #include <cstdio>
+#include <cstdlib>
 
 #include "common/util.h"
 
+#include "fs/trace.h"
+
+#include "nes/joy/controllers/standard.h"
+
 #include "gui_modules/emu.h"
 #include "gui_modules/widenes.h"
 #include "gui_modules/ppu_debug.h"
@@ -12,11 +17,24 @@ SDL_GUI::SDL_GUI(int argc, char* argv[]) {
   // Init config
   this->config.load(argc, argv);
 
+  // Decoding a CPU trace doesn't need the rest of the GUI
+  if (this->config.cli.decode_trace_path != "") {
+    bool ok = ANESE_fs::trace::decode_cpu_trace(
+      this->config.cli.decode_trace_path.c_str()
+    );
+    exit(ok ? 0 : 1);
+  }
+
   // Init NES params
-  this->nes_params.log_cpu         = this->config.cli.log_cpu;
-  this->nes_params.ppu_timing_hack = this->config.cli.ppu_timing_hack;
-  this->nes_params.apu_sample_rate = 96000;
-  this->nes_params.speed           = 100;
+  this->nes_params.log_cpu          = this->config.cli.log_cpu;
+  this->nes_params.ppu_timing_hack  = this->config.cli.ppu_timing_hack;
+  this->nes_params.ppu_extra_lines  = this->config.cli.overclock_lines;
+  this->nes_params.cpu_decode_cache = true;
+  this->nes_params.cpu_dynarec      = this->config.cli.dynarec;
+  this->nes_params.cpu_idle_loops   = true;
+  this->nes_params.apu_sample_rate  = 96000;
+  this->nes_params.apu_oversample   = this->config.cli.apu_oversample;
+  this->nes_params.speed            = 100;
 
   // Init NES
   this->nes = new NES(this->nes_params);
@@ -30,6 +48,18 @@ SDL_GUI::SDL_GUI(int argc, char* argv[]) {
       this->sdl_common.controller = SDL_GameControllerOpen(i);
     }
   }
+  // Open the audio device (unless running headless)
+  if (!this->config.cli.bench_frames) {
+    this->sdl_common.sound_queue = new Sound_Queue();
+    const char* error = this->sdl_common.sound_queue->init(
+      this->nes_params.apu_sample_rate, 1, this->config.cli.audio_latency
+    );
+    if (error) {
+      fprintf(stderr, "[SDL2] Couldn't open audio: %s\n", error);
+      delete this->sdl_common.sound_queue;
+      this->sdl_common.sound_queue = nullptr;
+    }
+  }
 
   /*----------  Init GUI modules  ----------*/
   this->shared = new SharedState(
@@ -41,6 +71,10 @@ SDL_GUI::SDL_GUI(int argc, char* argv[]) {
     *this->nes
   );
 
+  // Benchmarks run headless
+  if (this->config.cli.bench_frames)
+    return;
+
   this->modules["emu"] = (GUIModule*)new EmuModule(*this->shared);
 
   if (this->config.cli.ppu_debug)
@@ -59,6 +93,12 @@ SDL_GUI::~SDL_GUI() {
   this->config.save();
 
   // SDL Cleanup
+  if (Sound_Queue* audio = this->sdl_common.sound_queue) {
+    const Sound_Queue::stats_t stats = audio->stats();
+    fprintf(stderr, "[SDL2] Audio underruns: %lu, overruns: %lu\n",
+      stats.underruns, stats.overruns);
+    delete audio;
+  }
   SDL_GameControllerClose(this->sdl_common.controller);
   SDL_Quit();
 
@@ -87,6 +127,9 @@ int SDL_GUI::run() {
       return error;
   }
 
+  if (this->config.cli.bench_frames)
+    return this->bench();
+
   double past_fups [20] = {60.0}; // more samples == less value jitter
   uint past_fups_i = 0;
 
@@ -116,8 +159,21 @@ int SDL_GUI::run() {
       numframes++;
     }
 
+    // Frames are paced by the display (VSYNC), with audio kept in sync by
+    // nudging its rate (see EmuModule::output). That can't make up for a
+    // display that's way faster than 60Hz though, so if way too much audio is
+    // queued up, sit this frame out (instead of ever blocking on audio).
+    const Sound_Queue* audio = this->sdl_common.sound_queue;
+    if (audio && audio->sample_count() > 2 * audio->latency())
+      numframes = 0;
+
     // Run ANESE for some number of frames
+    // Only the last one gets presented, so don't bother drawing the others
+    // (unless wideNES is running, since it looks at every single frame)
+    const bool can_skip = this->modules.count("widenes") == 0;
     for (uint i = 0; i < numframes; i++) {
+      // (skipRender applies to the frame after the one that's about to run)
+      this->nes->skipRender(can_skip && i + 2 < numframes);
       if (!this->status.in_menu)
         this->nes->step_frame();
 
@@ -148,3 +204,49 @@ int SDL_GUI::run() {
 
   return 0;
 }
+
+int SDL_GUI::bench() {
+  if (this->config.cli.rom == "") {
+    fprintf(stderr, "[SDL2] No rom to benchmark!\n");
+    return 1;
+  }
+
+  const uint frames = this->config.cli.bench_frames;
+  fprintf(stderr, "[SDL2] Benchmarking %u frames...\n", frames);
+
+  // Benchmarks run without the EmuModule, which is what usually plugs in the
+  // controllers, so plug in a couple of idle ones (games poll them)
+  JOY_Standard joy_1 { "P1" };
+  JOY_Standard joy_2 { "P2" };
+  this->nes->attach_joy(0, &joy_1);
+  this->nes->attach_joy(1, &joy_2);
+
+  const u64 start = SDL_GetPerformanceCounter();
+
+  for (uint i = 0; i < frames; i++) {
+    this->nes->step_frame();
+
+    // nobody is listening, but the audio buffer still needs to be drained
+    float* samples = nullptr;
+    uint   count = 0;
+    this->nes->getAudiobuff(&samples, &count);
+  }
+
+  const double secs = double(SDL_GetPerformanceCounter() - start)
+                    / SDL_GetPerformanceFrequency();
+
+  printf("%u frames in %.3fs (%.1f fps)\n", frames, secs, frames / secs);
+
+  const PPU::SyncStats& stats = this->nes->_ppu().getSyncStats();
+  printf("PPU catch-ups: %llu, %.1f cycles each, "
+         "%llu scanlines drawn in one go\n",
+    (unsigned long long)stats.syncs,
+    stats.syncs ? double(stats.cycles) / stats.syncs : 0.0,
+    (unsigned long long)stats.fast_lines
+  );
+
+  this->nes->detach_joy(0);
+  this->nes->detach_joy(1);
+
+  return 0;
+}
@@ -35,6 +35,8 @@ private:
 private:
   void input_global(const SDL_Event&);
 
+  int bench(); // headless benchmark (see --bench)
+
 public:
   SDL_GUI(int argc, char* argv[]);
   ~SDL_GUI();
@@ -3,6 +3,7 @@
 #include <cstdio>
 
 #include "../fs/load.h"
+#include "../fs/trace.h"
 #include "../fs/util.h"
 
 EmuModule::EmuModule(SharedState& gui)
@@ -59,8 +60,6 @@ EmuModule::EmuModule(SharedState& gui)
   // this->sdl_common.nes_audiodev = SDL_OpenAudioDevice(NULL, 0, &as, &have, 0);
   // SDL_PauseAudioDevice(this->sdl_common.nes_audiodev, 0);
 
-  this->sdl.sound_queue.init(this->gui.nes_params.apu_sample_rate);
-
   /*----------  Submodule Init  ----------*/
 
   this->menu_submodule = new MenuSubModule(gui, this->sdl.window, this->sdl.renderer);
@@ -262,7 +261,8 @@ void EmuModule::input(const SDL_Event& event) {
         // Toggle CPU trace
         bool log = this->gui.nes_params.log_cpu = !this->gui.nes_params.log_cpu;
         this->gui.nes.updated_params();
-        fprintf(stderr, "NESTEST CPU logging: %s\n", log ? "ON" : "OFF");
+        fprintf(stderr, "CPU trace: %s\n", log ? "ON" : "OFF");
+        if (!log) this->dump_cpu_trace();
       } break;
       default: break;
       }
@@ -270,10 +270,26 @@ void EmuModule::input(const SDL_Event& event) {
   }
 }
 
+void EmuModule::dump_cpu_trace() {
+  if (this->gui.current_rom_file == "") return;
+  ANESE_fs::trace::dump_cpu_trace(
+    (this->gui.current_rom_file + ".trace").c_str(),
+    this->gui.nes._cpu_trace()
+  );
+}
+
 void EmuModule::update() {
   this->menu_submodule->update();
   if (this->gui.status.in_menu) return;
 
+  // dump the CPU trace when the NES crashes
+  if (this->nes_was_running && !this->gui.nes.isRunning()) {
+    fprintf(stderr, "[GUI][Emu] NES stopped running!\n");
+    if (this->gui.nes_params.log_cpu)
+      this->dump_cpu_trace();
+  }
+  this->nes_was_running = this->gui.nes.isRunning();
+
   // log frame to fm2
   if (this->fm2_record.is_enabled())
     this->fm2_record.step_frame();
@@ -289,12 +305,32 @@ void EmuModule::output() {
   uint   count = 0;
   this->gui.nes.getAudiobuff(&samples, &count);
   // SDL_QueueAudio(this->gui.sdl.nes_audiodev, samples, count * sizeof(float));
-  if (count) this->sdl.sound_queue.write(samples, count);
+  if (count && this->gui.sdl.sound_queue)
+    this->gui.sdl.sound_queue->write(samples, count);
+
+  // Dynamic rate control
+  // Video is synced to the display, which never refreshes at exactly the NES's
+  // ~60.0988Hz, so the audio queue would slowly run dry (crackling) or fill up
+  // (lag). Instead, the APU's output rate is nudged by up to 0.5% (which is
+  // inaudible), pulling the queue back towards its target latency.
+  // (see "Dynamic Rate Control for Retro Game Emulators", H. K. Arntzen)
+  if (const Sound_Queue* audio = this->gui.sdl.sound_queue) {
+    const double max_adjust = 0.005;
+    const double fill = double(audio->sample_count()) / audio->latency();
+    double adjust = max_adjust * (1.0 - fill);
+    if (adjust >  max_adjust) adjust =  max_adjust;
+    if (adjust < -max_adjust) adjust = -max_adjust;
+    this->gui.nes.adjustAudioRate(1.0 + adjust);
+  }
 
   // output video!
-  const u8* framebuffer;
-  this->gui.nes.getFramebuff(&framebuffer);
-  SDL_UpdateTexture(this->sdl.screen_texture, nullptr, framebuffer, 256 * 4);
+  // (converted straight into the texture, instead of going through a copy)
+  void* pixels;
+  int   pitch;
+  if (SDL_LockTexture(this->sdl.screen_texture, nullptr, &pixels, &pitch) == 0) {
+    this->gui.nes.copyFramebuff((u8*)pixels, pitch);
+    SDL_UnlockTexture(this->sdl.screen_texture);
+  }
 
   // actual NES screen
   SDL_SetRenderDrawColor(this->sdl.renderer, 0, 0, 0, 0xff);
@@ -305,9 +341,15 @@ void EmuModule::output() {
 
   SDL_RenderPresent(this->sdl.renderer);
 
-  // Present fups though the title of the main window
+  // Present fups (and how much audio is queued up) though the title of the
+  // main window
+  const Sound_Queue* audio = this->gui.sdl.sound_queue;
+  const uint audio_ms = audio && audio->sample_rate()
+    ? uint(audio->sample_count() * 1000 / audio->sample_rate())
+    : 0;
+
   char window_title [64];
-  sprintf(window_title, "anese - %u fups - %u%% speed",
-    uint(this->gui.status.avg_fps), this->gui.nes_params.speed);
+  sprintf(window_title, "anese - %u fups - %u%% speed - %ums audio",
+    uint(this->gui.status.avg_fps), this->gui.nes_params.speed, audio_ms);
   SDL_SetWindowTitle(this->sdl.window, window_title);
 }
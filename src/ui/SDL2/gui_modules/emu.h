@@ -17,8 +17,6 @@
 #include "../movies/fm2/record.h"
 #include "../movies/fm2/replay.h"
 
-#include "../util/Sound_Queue.h"
-
 class EmuModule : public GUIModule {
 private:
   struct {
@@ -28,7 +26,6 @@ private:
     SDL_Rect screen_rect;
     SDL_Texture* screen_texture = nullptr;
     // SDL_AudioDeviceID nes_audiodev;
-    Sound_Queue  sound_queue;
   } sdl;
 
   int speed_counter = 0;
@@ -43,6 +40,10 @@ private:
 
   MenuSubModule* menu_submodule;
 
+  // CPU trace is dumped (once) if the NES crashes
+  bool nes_was_running = false;
+  void dump_cpu_trace();
+
 public:
   virtual ~EmuModule();
   EmuModule(SharedState& gui);
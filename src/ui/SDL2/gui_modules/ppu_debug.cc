@@ -127,6 +127,8 @@ PPUDebugModule::PPUDebugModule(SharedState& gui) : GUIModule(gui) {
 PPUDebugModule::~PPUDebugModule() {
   fprintf(stderr, "[GUI][PPU Debug] Shutting down...\n");
 
+  this->gui.nes._ppu()._callbacks.scanline.remove_cb(PPUDebugModule::cb_scanline, this);
+
   delete name_t;
   delete nes_palette;
   delete palette_t;
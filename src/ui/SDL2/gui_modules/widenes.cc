@@ -18,6 +18,9 @@ WideNESModule::WideNESModule(SharedState& gui)
   gui.nes._ppu()._callbacks.write_start.add_cb(WideNESModule::cb_ppu_write_start, this);
   gui.nes._ppu()._callbacks.write_end.add_cb(WideNESModule::cb_ppu_write_end, this);
 
+  // the background-only framebuffer is used for scene detection / stitching
+  gui.nes._ppu().subscribeLayers(PPU::LAYER_BGR);
+
   /*-------------------------------  SDL init  -------------------------------*/
 
   fprintf(stderr, "[GUI][wideNES] Initializing...\n");
@@ -60,6 +63,15 @@ WideNESModule::~WideNESModule() {
   this->save_scenes();
   this->clear_scenes();
 
+  this->gui.nes._ppu().unsubscribeLayers(PPU::LAYER_BGR);
+
+  // unregister callbacks
+  this->gui.nes._callbacks.savestate_loaded.remove_cb(WideNESModule::cb_savestate_loaded, this);
+  this->gui.nes._callbacks.cart_changed.remove_cb(WideNESModule::cb_mapper_changed, this);
+  this->gui.nes._ppu()._callbacks.frame_end.remove_cb(WideNESModule::cb_ppu_frame_end, this);
+  this->gui.nes._ppu()._callbacks.write_start.remove_cb(WideNESModule::cb_ppu_write_start, this);
+  this->gui.nes._ppu()._callbacks.write_end.remove_cb(WideNESModule::cb_ppu_write_end, this);
+
   /*------------------------------  SDL Cleanup  -----------------------------*/
 
   SDL_DestroyTexture(this->nes_screen);
@@ -5,6 +5,7 @@
 #include <SDL.h>
 
 #include "config.h"
+#include "util/Sound_Queue.h"
 
 #include "nes/cartridge/cartridge.h"
 #include "nes/nes.h"
@@ -14,6 +15,7 @@ class GUIModule;
 
 struct SDL_Common {
   SDL_GameController* controller = nullptr;
+  Sound_Queue* sound_queue = nullptr; // null if running headless
 };
 
 struct GUIStatus {
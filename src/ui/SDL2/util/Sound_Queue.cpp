@@ -31,12 +31,15 @@ static const char* sdl_error( const char* str )
 }
 
 Sound_Queue::Sound_Queue()
+: write_pos( 0 )
+, read_pos( 0 )
+, underruns( 0 )
+, overruns( 0 )
 {
 	bufs = NULL;
-	free_sem = NULL;
-	write_buf = 0;
-	write_pos = 0;
-	read_buf = 0;
+	buf_size = 0;
+	latency_ = 0;
+	sample_rate_ = 0;
 	sound_open = false;
 }
 
@@ -48,36 +51,51 @@ Sound_Queue::~Sound_Queue()
 		SDL_CloseAudio();
 	}
 
-	if ( free_sem )
-		SDL_DestroySemaphore( free_sem );
-
 	delete [] bufs;
 }
 
 int Sound_Queue::sample_count() const
 {
-	int buf_free = SDL_SemValue( free_sem ) * buf_size + (buf_size - write_pos);
-	return buf_size * buf_count - buf_free;
+	return write_pos.load( std::memory_order_acquire ) -
+			read_pos.load( std::memory_order_acquire );
+}
+
+Sound_Queue::stats_t Sound_Queue::stats() const
+{
+	stats_t s;
+	s.underruns = underruns.load( std::memory_order_relaxed );
+	s.overruns  = overruns.load( std::memory_order_relaxed );
+	return s;
 }
 
-const char* Sound_Queue::init( long sample_rate, int chan_count )
+const char* Sound_Queue::init( long sample_rate, int chan_count, int latency_ms )
 {
 	assert( !bufs ); // can only be initialized once
 
-	bufs = new sample_t [(long) buf_size * buf_count];
+	sample_rate_ = sample_rate;
+	latency_ = sample_rate * chan_count * latency_ms / 1000;
+
+	// The device pulls samples in chunks of up to half the latency...
+	int dev_samples = 128;
+	while ( dev_samples * chan_count * 4 <= latency_ )
+		dev_samples *= 2;
+
+	// ...and the buffer has plenty of headroom past the latency, so a burst of
+	// frames (e.g: when fast-forwarding) doesn't overflow it
+	buf_size = 16384;
+	while ( buf_size < (unsigned) latency_ * 4 )
+		buf_size *= 2;
+
+	bufs = new sample_t [buf_size];
 	if ( !bufs )
 		return "Out of memory";
 
-	free_sem = SDL_CreateSemaphore( buf_count - 1 );
-	if ( !free_sem )
-		return sdl_error( "Couldn't create semaphore" );
-
 	SDL_AudioSpec as;
 	as.freq = sample_rate;
 	as.format = AUDIO_F32SYS;
 	as.channels = chan_count;
 	as.silence = 0;
-	as.samples = buf_size;
+	as.samples = dev_samples;
 	as.size = 0;
 	as.callback = fill_buffer_;
 	as.userdata = this;
@@ -89,50 +107,59 @@ const char* Sound_Queue::init( long sample_rate, int chan_count )
 	return NULL;
 }
 
-inline Sound_Queue::sample_t* Sound_Queue::buf( int index )
-{
-	assert( (unsigned) index < buf_count );
-	return bufs + (long) index * buf_size;
-}
-
 void Sound_Queue::write( const sample_t* in, int count )
 {
-	while ( count )
+	const unsigned mask = buf_size - 1;
+	const unsigned wpos = write_pos.load( std::memory_order_relaxed );
+	const unsigned used = wpos - read_pos.load( std::memory_order_acquire );
+
+	if ( (unsigned) count > buf_size - used )
 	{
-		int n = buf_size - write_pos;
-		if ( n > count )
-			n = count;
-
-		memcpy( buf( write_buf ) + write_pos, in, n * sizeof (sample_t) );
-		in += n;
-		write_pos += n;
-		count -= n;
-
-		if ( write_pos >= buf_size )
-		{
-			write_pos = 0;
-			write_buf = (write_buf + 1) % buf_count;
-			SDL_SemWait( free_sem );
-		}
+		overruns.fetch_add( 1, std::memory_order_relaxed );
+		count = buf_size - used;
 	}
+
+	// copy in (up to) two pieces, since the ring might wrap around
+	int n = buf_size - (wpos & mask);
+	if ( n > count )
+		n = count;
+	memcpy( bufs + (wpos & mask), in, n * sizeof (sample_t) );
+	memcpy( bufs, in + n, (count - n) * sizeof (sample_t) );
+
+	write_pos.store( wpos + count, std::memory_order_release );
 }
 
-void Sound_Queue::fill_buffer( Uint8* out, int count )
+void Sound_Queue::fill_buffer( Uint8* out_, int bytes )
 {
-	if ( SDL_SemValue( free_sem ) < buf_count - 1 )
-	{
-		memcpy( out, buf( read_buf ), count );
-		read_buf = (read_buf + 1) % buf_count;
-		SDL_SemPost( free_sem );
-	}
-	else
+	sample_t* out = (sample_t*) out_;
+	int count = bytes / sizeof (sample_t);
+
+	const unsigned mask = buf_size - 1;
+	const unsigned rpos = read_pos.load( std::memory_order_relaxed );
+	const unsigned wpos = write_pos.load( std::memory_order_acquire );
+
+	int avail = wpos - rpos;
+	if ( avail > count )
+		avail = count;
+
+	int n = buf_size - (rpos & mask);
+	if ( n > avail )
+		n = avail;
+	memcpy( out, bufs + (rpos & mask), n * sizeof (sample_t) );
+	memcpy( out + n, bufs, (avail - n) * sizeof (sample_t) );
+
+	// ran dry (which doesn't count before anything was ever written)
+	if ( avail < count )
 	{
-		memset( out, 0, count );
+		memset( out + avail, 0, (count - avail) * sizeof (sample_t) );
+		if ( wpos != 0 )
+			underruns.fetch_add( 1, std::memory_order_relaxed );
 	}
+
+	read_pos.store( rpos + avail, std::memory_order_release );
 }
 
 void Sound_Queue::fill_buffer_( void* user_data, Uint8* out, int count )
 {
 	((Sound_Queue*) user_data)->fill_buffer( out, count );
 }
-
@@ -1,41 +1,59 @@
-
-// Simple sound queue for synchronous sound handling in SDL
+// Simple sound queue for asynchronous sound handling in SDL
 
 // Copyright (C) 2005 Shay Green. MIT license.
+// Reworked for ANESE into a lock-free single-producer / single-consumer ring
+// buffer, so that writing samples never blocks the emulator.
 
 #ifndef SOUND_QUEUE_H
 #define SOUND_QUEUE_H
 
+#include <atomic>
+
 #include <SDL.h>
 
-// Simple SDL sound wrapper that has a synchronous interface
+// Simple SDL sound wrapper that never blocks the writer
 class Sound_Queue {
 public:
 	Sound_Queue();
 	~Sound_Queue();
 
-	// Initialize with specified sample rate and channel count.
-	// Returns NULL on success, otherwise error string.
-	const char* init( long sample_rate, int chan_count = 1 );
+	// Initialize with specified sample rate, channel count, and target latency
+	// (in milliseconds). Returns NULL on success, otherwise error string.
+	const char* init( long sample_rate, int chan_count = 1, int latency_ms = 50 );
 
 	// Number of samples in buffer waiting to be played
 	int sample_count() const;
 
-	// Write samples to buffer and block until enough space is available
+	// Number of samples the buffer aims to keep queued up (i.e: the latency)
+	int latency() const { return latency_; }
+
+	long sample_rate() const { return sample_rate_; }
+
+	// Write samples to buffer. Never blocks: samples that don't fit are dropped
 	typedef float sample_t;
 	void write( const sample_t*, int count );
 
+	struct stats_t {
+		unsigned long underruns; // times the device ran out of samples
+		unsigned long overruns;  // times written samples had to be dropped
+	};
+	stats_t stats() const;
+
 private:
-	enum { buf_size = 2048 };
-	enum { buf_count = 3 };
-	sample_t* volatile bufs;
-	SDL_sem* volatile free_sem;
-	int volatile read_buf;
-	int write_buf;
-	int write_pos;
-	bool sound_open;
-
-	sample_t* buf( int index );
+	sample_t* bufs;
+	unsigned  buf_size; // power of 2
+	int       latency_;
+	long      sample_rate_;
+	bool      sound_open;
+
+	// Both positions only ever go up (wrapping), and are masked on access.
+	// write_pos is only written by the writer, read_pos by the SDL callback.
+	std::atomic<unsigned> write_pos;
+	std::atomic<unsigned> read_pos;
+
+	std::atomic<unsigned long> underruns;
+	std::atomic<unsigned long> overruns;
+
 	void fill_buffer( Uint8*, int );
 	static void fill_buffer_( void*, Uint8*, int );
 };